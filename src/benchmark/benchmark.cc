@@ -0,0 +1,834 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * Scale benchmark, every address of 127.0.0.0/8 answers ICMP on the loopback interface.
+  *
+  *   benchmark checksum
+  *   benchmark checksum-verify
+  *   benchmark icmp <hosts> [seconds] [interval-ms] [shards]
+  *   benchmark stress <hosts> [seconds] [interval-ms]
+  *   benchmark tcp
+  *
+  * At a fixed probe rate (interval-ms proportional to the hosts) the dispatch latency and the cpu
+  * per probe don't depend on the number of hosts, the replies are found by payload id.
+  *
+  * The shards replace 'icmp-shards' from the configuration, 0 for one per core.
+  *
+  * The stress run stops the probes still in flight on every round, the next host started can
+  * take the slot of the stopped one while its reply is on the way. It fails if any reply is
+  * reported to a host other than the one it came from.
+  *
+  * The TCP run connects to a listening and to a closed loopback port, a RST answers for a host
+  * that is up; both must report an echo reply.
+  *
+  * The ICMP run needs an unprivileged ICMP socket (net.ipv4.ping_group_range) or CAP_NET_RAW;
+  * the backend follows the build and the 'icmp-uring' option on the [network] configuration.
+  */
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/tools/mainloop.h>
+ #include <udjat/tools/timer.h>
+ #include <udjat/net/icmp.h>
+ #include <udjat/net/ip/address.h>
+ #include <private/checksum.h>
+ #include <private/linux/icmp_controller.h>
+ #include <pugixml.hpp>
+ #include <sys/resource.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <arpa/inet.h>
+ #include <unistd.h>
+ #include <iostream>
+ #include <fstream>
+ #include <iomanip>
+ #include <algorithm>
+ #include <memory>
+ #include <vector>
+ #include <mutex>
+ #include <atomic>
+ #include <chrono>
+ #include <thread>
+ #include <cstring>
+ #include <cstdlib>
+
+ using namespace std;
+ using namespace Udjat;
+
+ static uint64_t nanoseconds() noexcept {
+	struct timespec tm;
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return (((uint64_t) tm.tv_sec) * 1000000000ULL) + ((uint64_t) tm.tv_nsec);
+ }
+
+ /// @brief Process CPU time, user and system (ns).
+ static uint64_t cputime() noexcept {
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF,&usage)) {
+		return 0;
+	}
+	return
+		(((uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)) * 1000000000ULL)
+		+ (((uint64_t) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)) * 1000ULL);
+ }
+
+ /// @brief Resident set size (bytes).
+ static uint64_t rss() noexcept {
+	unsigned long size = 0, resident = 0;
+	ifstream statm{"/proc/self/statm"};
+	statm >> size >> resident;
+	return ((uint64_t) resident) * ((uint64_t) sysconf(_SC_PAGESIZE));
+ }
+
+ /// @brief The checksum used before the vector engines, to compare with.
+ static unsigned short in_chksum(const unsigned short *buf, int sz) {
+
+	int nleft = sz;
+	int sum = 0;
+	const unsigned short *w = buf;
+	unsigned short ans = 0;
+
+	while (nleft > 1) {
+		sum += *w++;
+		nleft -= 2;
+	}
+
+	if (nleft == 1) {
+		*(unsigned char *) (&ans) = *(unsigned char *) w;
+		sum += ans;
+	}
+
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum += (sum >> 16);
+	ans = ~sum;
+	return ans;
+ }
+
+ /// @brief Time a checksum function on a buffer for half a second.
+ /// @return The time per call (ns).
+ template <typename T>
+ static double measure(vector<uint8_t> &buffer, size_t size, T checksum) {
+
+	volatile uint16_t sink = 0;
+	size_t rounds = 0;
+	uint64_t begin = nanoseconds();
+	uint64_t elapsed;
+
+	// Batches of calls between clock reads.
+	do {
+		for(size_t ix = 0; ix < 1024; ix++) {
+			buffer[0] = (uint8_t) ix;
+			sink = checksum(buffer.data(),size);
+		}
+		rounds += 1024;
+		elapsed = nanoseconds() - begin;
+	} while(elapsed < 500000000ULL);
+
+	(void) sink;
+
+	return ((double) elapsed) / ((double) rounds);
+
+ }
+
+ static int checksum() {
+
+	// From an empty echo request to a full MTU one.
+	static const size_t sizes[] = { 8, 16, 32, 64, 128, 256, 576, 1024, 1400 };
+
+	vector<uint8_t> buffer(1500);
+	for(size_t ix = 0; ix < buffer.size(); ix++) {
+		buffer[ix] = (uint8_t) (ix * 31);
+	}
+
+	cout << "checksum engine: " << Checksum::engine() << endl;
+
+	for(size_t size : sizes) {
+
+		double current = measure(buffer,size,[](const uint8_t *data, size_t length) {
+			return Checksum::get(data,length);
+		});
+
+		double legacy = measure(buffer,size,[](const uint8_t *data, size_t length) {
+			return in_chksum((const unsigned short *) data,(int) length);
+		});
+
+		cout << "checksum " << setw(5) << size << " bytes: "
+			<< fixed << setprecision(1) << current << " ns/call, "
+			<< setprecision(2) << (((double) size) / current) << " GB/s; in_chksum "
+			<< setprecision(1) << legacy << " ns/call, "
+			<< setprecision(2) << (legacy / current) << "x" << endl;
+
+	}
+
+	return 0;
+
+ }
+
+ /// @brief Reference checksum, the RFC 1071 sum of the big endian 16 bit words.
+ static uint16_t reference(const uint8_t *ptr, size_t length) noexcept {
+
+	uint32_t sum = 0;
+	for(size_t ix = 0; ix < length; ix += 2) {
+		sum += ((uint32_t) ptr[ix]) << 8;
+		if(ix + 1 < length) {
+			sum += ptr[ix+1];
+		}
+	}
+
+	while(sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+
+	// On the memory byte order, as Checksum::get().
+	return htons((uint16_t) ~sum);
+
+ }
+
+ /// @brief Compare a checksum function with the reference, on all lengths up to a MTU and unaligned.
+ /// @return The number of failures.
+ template <typename T>
+ static size_t verify(const char *name, T checksum) {
+
+	static const size_t offsets = 8;
+	static const size_t lengths = 1500;
+
+	// Random bytes and all ones, the worst case for the carries.
+	static vector<uint8_t> patterns[2];
+	if(patterns[0].empty()) {
+		patterns[0].resize(lengths + offsets);
+		patterns[1].assign(lengths + offsets,0xFF);
+		srand(1071);
+		for(uint8_t &byte : patterns[0]) {
+			byte = (uint8_t) rand();
+		}
+	}
+
+	size_t failures = 0;
+	size_t checks = 0;
+
+	for(vector<uint8_t> &pattern : patterns) {
+		for(size_t offset = 0; offset < offsets; offset++) {
+			for(size_t length = 0; length <= lengths; length++) {
+
+				const uint8_t *data = pattern.data() + offset;
+				uint16_t value = checksum(data,length);
+				uint16_t expected = reference(data,length);
+
+				checks++;
+				if(value != expected && !failures++) {
+					cerr << name << ": length " << length << " offset " << offset
+						<< " got 0x" << hex << value << " expected 0x" << expected << dec << endl;
+				}
+
+			}
+		}
+	}
+
+	cout << "checksum " << setw(8) << name << ": " << checks << " checks, " << failures << " failure(s)" << endl;
+	return failures;
+
+ }
+
+ /// @brief Check the incremental update against a full checksum, on even and odd regions.
+ /// @return The number of failures.
+ static size_t update() {
+
+	static const size_t lengths = 1500;
+
+	vector<uint8_t> before(lengths + 2), after(lengths + 2);
+
+	srand(1624);
+	size_t failures = 0;
+	size_t checks = 0;
+
+	// Regions start at an even offset of the packet, up to its end or with a byte after them.
+	for(size_t start = 0; start <= 2; start += 2) {
+		for(size_t length = 0; length + start <= lengths; length++) {
+			for(size_t trailing = 0; trailing <= 1; trailing++) {
+
+				size_t size = start + length + trailing;
+
+				for(size_t ix = 0; ix < size; ix++) {
+					before[ix] = after[ix] = (uint8_t) rand();
+				}
+				for(size_t ix = start; ix < start + length; ix++) {
+					after[ix] = (uint8_t) rand();
+				}
+
+				uint16_t value = Checksum::update(Checksum::get(before.data(),size),before.data()+start,after.data()+start,length);
+				uint16_t expected = Checksum::get(after.data(),size);
+
+				checks++;
+				if(value != expected && !failures++) {
+					cerr << "update: region " << start << "+" << length << " of " << size
+						<< " got 0x" << hex << value << " expected 0x" << expected << dec << endl;
+				}
+
+			}
+		}
+	}
+
+	cout << "checksum " << setw(8) << "update" << ": " << checks << " checks, " << failures << " failure(s)" << endl;
+	return failures;
+
+ }
+
+ /// @brief Check the raw socket echo requests, host, path and MTU probes, against a full checksum.
+ /// @return The number of failures.
+ static size_t probes() {
+
+	static const uint8_t ttls[] = { 0, 1, 2, 30, 64, 255 };
+	static const uint16_t mtus[] = { 0, 68, 255, 256, 576, 1400, 1500, 9000 };
+
+	// As the controller builds it.
+	ICMP::Controller::Packet model;
+	memset(&model,0,sizeof(model));
+	model.icmp.icmp_type = ICMP_ECHO;
+	model.icmp.icmp_id = htons(0x1234);
+	model.icmp.icmp_cksum = Checksum::get(&model,sizeof(model));
+
+	srand(1191);
+	size_t failures = 0;
+	size_t checks = 0;
+
+	for(uint8_t ttl : ttls) {
+		for(uint16_t mtu : mtus) {
+			for(size_t round = 0; round < 64; round++) {
+
+				ICMP::Controller::Packet packet = model;
+				memset(&packet.payload,0,sizeof(packet.payload));
+				packet.payload.id = (uint32_t) rand();
+				packet.payload.token = (uint32_t) rand();
+				packet.payload.seq = (uint16_t) rand();
+				packet.payload.time = (((uint64_t) rand()) << 32) | (uint64_t) rand();
+				packet.payload.ttl = ttl;
+				packet.payload.mtu = mtu;
+				packet.icmp.icmp_seq = htons((uint16_t) rand());
+
+				uint16_t value = ICMP::Controller::checksum(model,packet);
+
+				packet.icmp.icmp_cksum = 0;
+				uint16_t expected = Checksum::get(&packet,sizeof(packet));
+
+				checks++;
+				if(value != expected && !failures++) {
+					cerr << "probe: ttl " << (unsigned int) ttl << " mtu " << mtu
+						<< " got 0x" << hex << value << " expected 0x" << expected << dec << endl;
+				}
+
+			}
+		}
+	}
+
+	cout << "checksum " << setw(8) << "probes" << ": " << checks << " checks, " << failures << " failure(s)" << endl;
+	return failures;
+
+ }
+
+ static int verify() {
+
+	static const char *engines[] = { "avx2", "sse2", "neon", "generic" };
+
+	size_t failures = 0;
+
+	for(const char *engine : engines) {
+
+		uint16_t value;
+		if(!Checksum::get(engine,nullptr,0,value)) {
+			cout << "checksum " << setw(8) << engine << ": not available" << endl;
+			continue;
+		}
+
+		failures += verify(engine,[engine](const uint8_t *data, size_t length) {
+			uint16_t value = 0;
+			Checksum::get(engine,data,length,value);
+			return value;
+		});
+
+	}
+
+	// The selected engine, with the short buffer path.
+	failures += verify("selected",[](const uint8_t *data, size_t length) {
+		return Checksum::get(data,length);
+	});
+
+	failures += update();
+	failures += probes();
+
+	return failures ? 1 : 0;
+
+ }
+
+ /// @brief Probes every host once per interval, as many as the rate allows on every tick.
+ class Benchmark : private MainLoop::Timer {
+ private:
+
+	class Probe : public ICMP::Worker {
+	private:
+		Benchmark &benchmark;
+
+	protected:
+		void set(const ICMP::Response response, const IP::Address &from) override {
+			benchmark.complete(*this,response,from);
+		}
+
+	public:
+		uint64_t started = 0;	///< @brief Time of the last start() (ns).
+
+		Probe(Benchmark &b, const sockaddr_in &addr, const ICMP::Worker::Timers &timers) : ICMP::Worker{timers}, benchmark{b} {
+			IP::Address::set(addr);
+		}
+
+		using ICMP::Worker::start;
+		using ICMP::Worker::stop;
+
+	};
+
+	const uint64_t memory;		///< @brief RSS before creating the probes.
+	const uint64_t duration;	///< @brief Run length (ns).
+	const uint64_t rate;		///< @brief Probes per second.
+	const bool churn;			///< @brief Stop the probes in flight instead of skipping them.
+
+	vector<unique_ptr<Probe>> probes;
+
+	/// @brief Next probe to start, round robin.
+	size_t next = 0;
+
+	/// @brief Probes allowed, in thousandths.
+	uint64_t credit = 0;
+
+	uint64_t begin = 0;
+	uint64_t last = 0;
+
+	mutex guard;
+
+	struct {
+		uint64_t started = 0;		///< @brief Probes started.
+		uint64_t busy = 0;			///< @brief Probes skipped, the previous one still running.
+		uint64_t stopped = 0;		///< @brief Probes stopped in flight.
+		uint64_t mismatched = 0;	///< @brief Replies reported to the wrong host.
+		uint64_t failed = 0;		///< @brief Probes start() refused.
+		uint64_t replies = 0;
+		uint64_t timeouts = 0;
+		uint64_t errors = 0;
+	} count;
+
+	/// @brief Time from start() to the reply notification (ns), allocated and touched before the run.
+	vector<uint64_t> latency;
+	size_t samples = 0;
+
+	void on_timer() override {
+
+		uint64_t now = nanoseconds();
+
+		if(now - begin >= duration) {
+			MainLoop::Timer::disable();
+			MainLoop::getInstance().quit();
+			return;
+		}
+
+		credit += ((now - last) / 1000000ULL) * rate;
+		last += ((now - last) / 1000000ULL) * 1000000ULL;
+
+		// Don't burst after a stall, at most one second of probes.
+		if(credit > rate * 1000) {
+			credit = rate * 1000;
+		}
+
+		size_t skipped = 0;
+		while(credit >= 1000 && skipped < probes.size()) {
+
+			Probe &probe = *probes[next];
+			next = (next + 1) % probes.size();
+
+			if(probe.running()) {
+
+				if(churn) {
+					// Free the slot with the reply on the way.
+					probe.stop();
+					count.stopped++;
+				} else {
+					count.busy++;
+				}
+
+				skipped++;
+				continue;
+
+			}
+
+			credit -= 1000;
+
+			probe.started = nanoseconds();
+			try {
+				probe.start();
+				count.started++;
+			} catch(const std::exception &e) {
+				if(!count.failed++) {
+					cerr << "Cant start probe: " << e.what() << endl;
+				}
+			}
+
+		}
+
+	}
+
+ public:
+
+	Benchmark(size_t hosts, unsigned long seconds, unsigned long interval, bool c = false)
+		: MainLoop::Timer{10}, memory{rss()}, duration{((uint64_t) seconds) * 1000000000ULL}, rate{(((uint64_t) hosts) * 1000) / interval}, churn{c} {
+
+		ICMP::Worker::Timers timers{1000,interval};
+
+		probes.reserve(hosts);
+		for(size_t ix = 0; ix < hosts; ix++) {
+			sockaddr_in addr;
+			memset(&addr,0,sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(0x7F000001 + (uint32_t) ix);
+			probes.emplace_back(new Probe(*this,addr,timers));
+		}
+
+		latency.assign(((size_t) rate) * (size_t) seconds,0);
+
+	}
+
+	~Benchmark() {
+		MainLoop::Timer::disable();
+		for(auto &probe : probes) {
+			probe->stop();
+		}
+	}
+
+	void complete(Probe &probe, const ICMP::Response response, const IP::Address &from) {
+
+		uint64_t now = nanoseconds();
+
+		lock_guard<mutex> lock(guard);
+
+		switch(response) {
+		case ICMP::echo_reply:
+			count.replies++;
+			if(((const sockaddr_in *) &from)->sin_addr.s_addr != ((const sockaddr_in *) (const sockaddr_storage *) &probe)->sin_addr.s_addr) {
+				if(!count.mismatched++) {
+					cerr << "Reply from " << std::to_string(from) << " reported to " << std::to_string((IP::Address) probe) << endl;
+				}
+			}
+			if(samples < latency.size()) {
+				latency[samples++] = now - probe.started;
+			}
+			break;
+
+		case ICMP::timeout:
+			count.timeouts++;
+			break;
+
+		default:
+			count.errors++;
+
+		}
+
+	}
+
+	int run() {
+
+		begin = last = nanoseconds();
+		uint64_t cpu = cputime();
+
+		MainLoop::Timer::enable();
+		MainLoop::getInstance().run();
+
+		uint64_t elapsed = nanoseconds() - begin;
+		cpu = cputime() - cpu;
+
+		// The controller tables are at their largest while the probes are running.
+		uint64_t resident = rss() - (latency.size() * sizeof(latency[0]));
+
+		for(auto &probe : probes) {
+			probe->stop();
+		}
+
+		lock_guard<mutex> lock(guard);
+
+		double seconds = ((double) elapsed) / 1000000000.0;
+
+		cout << "hosts:          " << probes.size() << endl;
+		cout << "duration:       " << fixed << setprecision(2) << seconds << " s" << endl;
+		cout << "probes:         " << count.started << " started, " << count.busy << " skipped (busy), " << count.failed << " failed" << endl;
+		if(churn) {
+			cout << "stopped:        " << count.stopped << " in flight" << endl;
+		}
+		cout << "answers:        " << count.replies << " replies, " << count.timeouts << " timeouts, " << count.errors << " errors" << endl;
+		cout << "mismatched:     " << count.mismatched << endl;
+		cout << "probes/sec:     " << setprecision(0) << (((double) count.started) / seconds) << endl;
+		cout << "replies/sec:    " << setprecision(0) << (((double) count.replies) / seconds) << endl;
+
+		if(samples) {
+
+			auto first = latency.begin();
+			auto end = latency.begin() + samples;
+
+
+			// start() to set(), queueing and dispatch on top of the loopback RTT.
+			static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+			cout << "dispatch (us):  ";
+			for(double percentile : percentiles) {
+				size_t index = (size_t) ((percentile / 100.0) * (double) (samples - 1));
+				nth_element(first,first+index,end);
+				cout << "p" << setprecision(percentile < 99.5 ? 0 : 1) << percentile
+					<< "=" << setprecision(1) << (((double) latency[index]) / 1000.0) << " ";
+			}
+			cout << "max=" << (((double) *max_element(first,end)) / 1000.0) << endl;
+
+		}
+
+		cout << "cpu:            " << setprecision(3) << (((double) cpu) / 1000000000.0) << " s";
+		if(count.started) {
+			cout << ", " << setprecision(3) << ((((double) cpu) / 1000000000.0) * 100000.0 / ((double) count.started)) << " s per 100k probes";
+		}
+		cout << endl;
+
+		cout << "rss/host:       " << setprecision(0)
+			<< (((double) (resident > memory ? resident - memory : 0)) / ((double) probes.size())) << " bytes" << endl;
+
+		if(!count.started && count.failed) {
+			// No ICMP socket, skipped when running as a test.
+			return 77;
+		}
+
+		return (count.replies && !count.mismatched ? 0 : 1);
+
+	}
+
+ };
+
+ /// @brief TCP connect probes of loopback ports.
+ class Connect : private MainLoop::Timer {
+ private:
+
+	class Probe : public ICMP::Worker {
+	protected:
+		void set(const ICMP::Response response, const IP::Address &) override {
+			this->response = response;
+			done = true;
+		}
+
+	public:
+		const char *name;
+		ICMP::Response response = ICMP::invalid;
+		atomic<bool> done{false};
+
+		Probe(const char *n, const pugi::xml_node &node) : ICMP::Worker{node,"127.0.0.1"}, name{n} {
+		}
+
+		using ICMP::Worker::start;
+		using ICMP::Worker::stop;
+
+	};
+
+	vector<unique_ptr<Probe>> probes;
+
+	/// @brief Give up time (ns).
+	uint64_t limit = 0;
+
+	void on_timer() override {
+
+		for(auto &probe : probes) {
+			if(!probe->done && nanoseconds() < limit) {
+				return;
+			}
+		}
+
+		MainLoop::Timer::disable();
+		MainLoop::getInstance().quit();
+
+	}
+
+ public:
+
+	Connect() : MainLoop::Timer{10} {
+	}
+
+	~Connect() {
+		MainLoop::Timer::disable();
+		for(auto &probe : probes) {
+			probe->stop();
+		}
+	}
+
+	void push_back(const char *name, uint16_t port) {
+
+		pugi::xml_document document;
+		pugi::xml_node node = document.append_child("host");
+		node.append_attribute("probe") = "tcp";
+		node.append_attribute("tcp-port") = (unsigned int) port;
+		node.append_attribute("icmp-timeout") = 2;
+
+		probes.emplace_back(new Probe(name,node));
+
+	}
+
+	int run() {
+
+		limit = nanoseconds() + 5000000000ULL;
+
+		for(auto &probe : probes) {
+			probe->start();
+		}
+
+		MainLoop::Timer::enable();
+		MainLoop::getInstance().run();
+
+		int rc = 0;
+		for(auto &probe : probes) {
+
+			ICMP::Statistics::Summary summary = probe->getStatistics();
+
+			cout << "tcp " << setw(6) << probe->name << " port: " << std::to_string(probe->response)
+				<< ", rtt " << fixed << setprecision(1) << (((double) summary.last) / 1000.0) << " us" << endl;
+
+			if(probe->response != ICMP::echo_reply || !summary.received) {
+				rc = 1;
+			}
+
+		}
+
+		return rc;
+
+	}
+
+ };
+
+ /// @brief Get a free loopback port.
+ /// @param listening Listen on it, the socket is returned on sock.
+ static uint16_t port(int &sock, bool listening) {
+
+	sock = socket(AF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+	if(sock < 0) {
+		return 0;
+	}
+
+	sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(addr);
+
+	if(bind(sock,(sockaddr *) &addr,sizeof(addr)) || (listening && listen(sock,16)) || getsockname(sock,(sockaddr *) &addr,&length)) {
+		::close(sock);
+		sock = -1;
+		return 0;
+	}
+
+	if(!listening) {
+		// Released, nothing listens on it.
+		::close(sock);
+		sock = -1;
+	}
+
+	return ntohs(addr.sin_port);
+
+ }
+
+ static int tcp() {
+
+	// The kernel completes the handshakes, no need to accept them.
+	int listener, closed;
+	uint16_t open = port(listener,true);
+	uint16_t refused = port(closed,false);
+
+	if(!(open && refused)) {
+		cerr << "Cant get loopback ports: " << strerror(errno) << endl;
+		if(listener >= 0) {
+			::close(listener);
+		}
+		return 77;
+	}
+
+	int rc;
+
+	try {
+
+		Connect connect;
+		connect.push_back("open",open);
+		connect.push_back("closed",refused);
+		rc = connect.run();
+
+	} catch(const std::exception &e) {
+
+		cerr << e.what() << endl;
+		rc = -1;
+
+	}
+
+	::close(listener);
+	return rc;
+
+ }
+
+ int main(int argc, char **argv) {
+
+	if(argc < 2 || !strcmp(argv[1],"checksum")) {
+		return checksum();
+	}
+
+	if(!strcmp(argv[1],"checksum-verify")) {
+		return verify();
+	}
+
+	if(!strcmp(argv[1],"tcp")) {
+		return tcp();
+	}
+
+	bool stress = !strcmp(argv[1],"stress");
+
+	if((strcmp(argv[1],"icmp") && !stress) || argc < 3) {
+		cerr << "Usage: " << argv[0] << " checksum | checksum-verify | icmp <hosts> [seconds] [interval-ms] [shards] | stress <hosts> [seconds] [interval-ms] | tcp" << endl;
+		return -1;
+	}
+
+	size_t hosts = (size_t) strtoul(argv[2],nullptr,10);
+	unsigned long seconds = (argc > 3 ? strtoul(argv[3],nullptr,10) : 10);
+	unsigned long interval = (argc > 4 ? strtoul(argv[4],nullptr,10) : (stress ? 10 : 1000));
+
+	if(!hosts || hosts > 0xFFFFFE || !seconds || !interval) {
+		cerr << "Invalid arguments" << endl;
+		return -1;
+	}
+
+	if(argc > 5 && !stress) {
+		// Before the first probe, the shards are created with it.
+		unsigned int shards = (unsigned int) strtoul(argv[5],nullptr,10);
+		ICMP::Controller::shards = (shards ? shards : thread::hardware_concurrency());
+		cout << "shards:         " << ICMP::Controller::shards << endl;
+	}
+
+	try {
+
+		Benchmark benchmark{hosts,seconds,interval,stress};
+		return benchmark.run();
+
+	} catch(const std::exception &e) {
+
+		cerr << e.what() << endl;
+		return -1;
+
+	}
+
+ }
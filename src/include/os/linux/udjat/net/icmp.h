@@ -25,6 +25,12 @@
  #include <udjat/tools/value.h>
  #include <udjat/agent/state.h>
  #include <iostream>
+ #include <atomic>
+ #include <memory>
+ #include <mutex>
+ #include <vector>
+ #include <functional>
+ #include <future>
 
  namespace Udjat {
 
@@ -36,51 +42,360 @@
 			destination_unreachable,
 			time_exceeded,
 			timeout,
-			network_unreachable
+			network_unreachable,
+			mtu_reduced				///< @brief Host is active, the path MTU is below the 'icmp-mtu-min' threshold.
 		};
 
 		class Controller;
+		class Delivery;
+
+	}
+
+	namespace TCP {
+		class Controller;
+	}
+
+	namespace ICMP {
+
+		/// @brief ICMP probe statistics.
+		/// @details Updated by the ICMP controller and read from any thread without locks, readers
+		/// retry when an update happens during the copy (seqlock). RTT percentiles are taken from
+		/// fixed log-linear histograms covering the last 'window' to 2*'window' probes.
+		class UDJAT_API Statistics {
+		public:
+
+			/// @brief Number of probes on each half of the sliding window.
+			static constexpr size_t window = 64;
+
+			/// @brief Number of histogram buckets (8 per power of two microseconds).
+			static constexpr size_t buckets = 232;
+
+			/// @brief Values read from the statistics.
+			struct Summary {
+				uint64_t sent = 0;			///< @brief Probes sent.
+				uint64_t received = 0;		///< @brief Replies received.
+				uint64_t duplicates = 0;	///< @brief Duplicated replies.
+				uint64_t reordered = 0;		///< @brief Replies received out of order.
+				float loss = 0;				///< @brief Packet loss on the window (%).
+				uint64_t jitter = 0;		///< @brief RTT jitter (ns).
+				uint64_t last = 0;			///< @brief Last RTT (ns).
+				uint64_t min = 0;			///< @brief Minimum RTT on the window (ns).
+				uint64_t avg = 0;			///< @brief Average RTT on the window (ns).
+				uint64_t p50 = 0;			///< @brief RTT median on the window (ns).
+				uint64_t p95 = 0;			///< @brief RTT 95th percentile on the window (ns).
+				uint64_t p99 = 0;			///< @brief RTT 99th percentile on the window (ns).
+				uint64_t max = 0;			///< @brief Maximum RTT on the window (ns).
+			};
+
+			Statistics() noexcept;
+
+			/// @brief Register a probe.
+			/// @return The probe sequence number.
+			uint16_t sent() noexcept;
+
+			/// @brief Register an echo reply.
+			/// @param seq The probe sequence number.
+			/// @param rtt Round trip time (ns).
+			void received(uint16_t seq, uint64_t rtt) noexcept;
+
+			/// @brief Get consistent copy of the statistics.
+			Summary get() const noexcept;
+
+			/// @brief Seed the statistics with a previous summary (warm start).
+			/// @details Totals are restored; loss and RTT go to the older half of the window as
+			/// replies of the average RTT, they're replaced as new probes are sent.
+			void restore(const Summary &summary) noexcept;
+
+			Value & getProperties(Value &value) const;
 
-		class UDJAT_API Worker : public Udjat::IP::Address {
 		private:
 
-			friend class Controller;
+			mutable std::atomic<uint32_t> version{0};
+
+			/// @brief Half of the sliding window.
+			struct Window {
+				std::atomic<uint32_t> sent{0};
+				std::atomic<uint32_t> received{0};
+				std::atomic<uint64_t> sum{0};
+				std::atomic<uint64_t> min{0};
+				std::atomic<uint64_t> max{0};
+				std::atomic<uint32_t> histogram[buckets];
+			} windows[2];
+
+			std::atomic<uint8_t> current{0};
+
+			std::atomic<uint64_t> count_sent{0};
+			std::atomic<uint64_t> count_received{0};
+			std::atomic<uint64_t> duplicates{0};
+			std::atomic<uint64_t> reordered{0};
+			std::atomic<uint64_t> jitter{0};
+			std::atomic<uint64_t> last{0};
+
+			// Writer only.
+			uint16_t sequence = 0;		///< @brief Last sequence sent.
+			uint16_t highest = 0;		///< @brief Highest sequence received.
+			uint64_t seen = 0;			///< @brief Received sequences, bit n is 'highest - n'.
+
+			void begin() noexcept;
+			void end() noexcept;
+
+		};
+
+		/// @brief Per hop statistics of the path to a host (MTR style).
+		/// @details Every probe round sends echo requests with TTL 1 to 'size()' at once, hops
+		/// answer with time exceeded and the host with echo replies from its distance on.
+		class UDJAT_API Path {
+		public:
+
+			struct Hop {
+				IP::Address address;		///< @brief Address answering at this TTL.
+				uint64_t sent = 0;			///< @brief Probes sent.
+				uint64_t received = 0;		///< @brief Answers received.
+				uint64_t last = 0;			///< @brief Last RTT (ns).
+				uint64_t best = 0;			///< @brief Best RTT (ns).
+				uint64_t worst = 0;			///< @brief Worst RTT (ns).
+				uint64_t sum = 0;			///< @brief Sum of the RTTs, for the average (ns).
+			};
+
+			/// @param hops The highest TTL probed.
+			Path(uint8_t hops);
+
+			inline uint8_t size() const noexcept {
+				return (uint8_t) hops.size();
+			}
+
+			/// @brief Register a probe round.
+			void sent() noexcept;
+
+			/// @brief Register an answer.
+			/// @param ttl The TTL of the probe.
+			/// @param from The address answering.
+			/// @param rtt Round trip time (ns).
+			/// @param reached true if the answer was an echo reply from the host.
+			void received(uint8_t ttl, const sockaddr_storage &from, uint64_t rtt, bool reached) noexcept;
+
+			/// @brief Get the hops, up to the host distance.
+			std::vector<Hop> get() const;
+
+			Value & getProperties(Value &value) const;
+
+		private:
+			mutable std::mutex guard;
+			std::vector<Hop> hops;
+
+			/// @brief Lowest TTL answered by the host, zero if not reached.
+			uint8_t distance = 0;
+
+		};
+
+		/// @brief Path MTU discovery, binary search of the largest packet reaching the host.
+		/// @details Every probe round carries one echo request with DF set. Replies raise the lower
+		/// bound; fragmentation needed, local EMSGSIZE or a lost probe (a blackhole) lower the upper
+		/// one. Once converged the MTU is confirmed on every round and searched again if it fails.
+		class UDJAT_API MTU {
+		public:
+
+			/// @param threshold Lowest healthy MTU, zero to disable the check.
+			/// @param floor Smallest probe size.
+			/// @param ceiling Largest probe size.
+			MTU(uint16_t threshold, uint16_t floor, uint16_t ceiling);
+
+			/// @brief Get the size of the next probe, the unanswered one is taken as failed.
+			/// @return IP packet size.
+			uint16_t next() noexcept;
+
+			/// @brief A probe was answered.
+			/// @param size IP packet size.
+			void passed(uint16_t size) noexcept;
+
+			/// @brief Packets of the size don't reach the host.
+			/// @param size IP packet size.
+			void failed(uint16_t size) noexcept;
+
+			/// @brief Get the path MTU.
+			/// @return The MTU or zero if not discovered yet.
+			inline uint16_t get() const noexcept {
+				return value.load();
+			}
+
+			/// @brief Is the MTU below the threshold?
+			inline bool reduced() const noexcept {
+				uint16_t mtu = value.load();
+				return mtu && mtu < threshold;
+			}
+
+			Value & getProperties(Value &value) const;
+
+		private:
+			const uint16_t threshold;
+			const uint16_t floor;
+			const uint16_t ceiling;
+
+			// Controller only.
+			uint16_t low;				///< @brief Largest size answered.
+			uint16_t high;				///< @brief Smallest size known to fail.
+			uint16_t probing = 0;		///< @brief Size of the unanswered probe, zero if none.
+			unsigned int rounds = 0;	///< @brief Confirmations since the last search.
+
+			std::atomic<uint16_t> value{0};
+
+		};
+
+		class UDJAT_API Worker : public Udjat::IP::Address {
+		public:
+
+			/// @brief Probe priority, when the egress budget is short the higher classes are served first.
+			enum Priority : uint8_t {
+				high,
+				normal,
+				low				///< @brief Probes are skipped, not queued, when the controller is lagging.
+			};
+
+			/// @brief How the host is probed ('probe').
+			enum Method : uint8_t {
+				icmp_echo,		///< @brief ICMP echo requests.
+				tcp_connect,	///< @brief Non blocking connect to 'tcp-port', for hosts dropping ICMP.
+				udp_datagram	///< @brief Small datagram to 'udp-port', a closed port answers with port unreachable.
+			};
 
 			struct Timers {
-				const time_t timeout;		///< @brief ICMP timeout.
-				const time_t interval;		///< @brief ICMP packet interval.
+				const unsigned long timeout;		///< @brief ICMP timeout (ms).
+				const unsigned long interval;		///< @brief ICMP packet interval (ms).
+				const unsigned long ceiling;		///< @brief Longest adaptive interval (ms), zero when not adaptive.
 
-				constexpr Timers(time_t t, time_t i) : timeout{t}, interval{i} {
+				constexpr Timers(unsigned long t, unsigned long i, unsigned long c = 0) : timeout{t}, interval{i}, ceiling{c} {
 				}
 
-			} timers;
+				/// @brief Get timers from the 'icmp-timeout' and 'icmp-interval' attributes.
+				/// @details With 'icmp-adaptive' the host stays on the controller and the interval doubles on
+				/// every healthy reply up to 'icmp-adaptive-max' (default 1m), returning to 'icmp-interval'
+				/// on the first loss or RTT deviation.
+				/// @param timeout Default timeout (ms).
+				/// @param interval Default interval (ms).
+				Timers(const pugi::xml_node &node, unsigned long timeout = 5000, unsigned long interval = 1000);
+
+			};
+
+		private:
+
+			friend class Controller;
+			friend class TCP::Controller;
+			friend class Delivery;
+
+			const Timers timers;
+
+			const Priority priority = normal;		///< @brief Probe priority ('icmp-priority').
+
+			const Method method = icmp_echo;		///< @brief Probe method ('probe').
+
+			const uint16_t port = 0;				///< @brief Port of the TCP or UDP probes ('tcp-port', 'udp-port').
+
+			/// @brief Path statistics, only when 'icmp-path' sets the number of hops to probe.
+			/// @details With path probing the host stays on the controller, one probe round every interval.
+			std::unique_ptr<Path> path;
+
+			/// @brief Path MTU discovery, only with 'icmp-pmtu'.
+			/// @details With discovery the host stays on the controller, one probe round every interval.
+			std::unique_ptr<MTU> mtu;
+
+			/// @brief Length of the echo requests, zero for the smallest ('icmp-size').
+			const uint16_t length = 0;
+
+			Statistics statistics;			///< @brief Probe statistics.
+
+			/// @brief Controller shard of the last start(), cleared when the controller drops the worker.
+			std::atomic<Controller *> controller{nullptr};
+
+			/// @brief TCP controller of the last start(), cleared by stop().
+			std::atomic<TCP::Controller *> connector{nullptr};
 
-			uint64_t time = 0;				///< @brief Time of last response.
-			bool busy = false;
+			/// @brief Is the worker on the controller host table (or queued to it)?
+			std::atomic<bool> busy{false};
 
 		protected:
 
 			virtual void set(const ICMP::Response response, const IP::Address &from) = 0;
 
 			void start();
+
+			/// @brief Stop probing the worker.
+			/// @details Waits for a set() running on another thread, it must not be called
+			/// holding a lock that set() takes.
 			void stop();
 
 		public:
+
+			/// @brief Create worker.
+			/// @param timeout ICMP timeout in seconds.
+			/// @param interval ICMP packet interval in seconds.
 			Worker(time_t timeout = 5, time_t interval = 1);
+
+			/// @brief Create worker with preset timers.
+			/// @details Used by agents owning many workers, doesn't log the process capabilities.
+			Worker(const Timers &timers);
+
+			/// @brief Create worker with preset timers and priority.
+			Worker(const Timers &timers, Priority priority);
+
+			/// @brief Create worker from XML node.
+			/// @details The attributes 'icmp-timeout' and 'icmp-interval' are in seconds
+			/// unless suffixed with an unit ('200ms', '1.5s', '1m'); with probe='tcp' the host is
+			/// checked by connecting to 'tcp-port', with probe='udp' by sending datagrams to 'udp-port'.
+			/// A refused connect proves the host is up and reports an echo reply, closed UDP ports
+			/// report destination unreachable.
 			Worker(const pugi::xml_node &node, const char *addr = nullptr);
 
 			virtual ~Worker();
 
-			inline time_t interval() const noexcept {
+			/// @brief Get the ICMP packet interval.
+			/// @return Interval in milliseconds.
+			inline unsigned long interval() const noexcept {
 				return timers.interval;
 			}
 
-			inline time_t timeout() const noexcept {
+			/// @brief Get the ICMP timeout.
+			/// @return Timeout in milliseconds.
+			inline unsigned long timeout() const noexcept {
 				return timers.timeout;
 			}
 
+			inline Priority getPriority() const noexcept {
+				return priority;
+			}
+
+			/// @brief Is the probe interval adaptive?
+			inline bool adaptive() const noexcept {
+				return timers.ceiling != 0;
+			}
+
+			inline Method getMethod() const noexcept {
+				return method;
+			}
+
 			inline bool running() const noexcept {
-				return busy;
+				return busy.load();
+			}
+
+			/// @brief Get path statistics.
+			/// @return The path or nullptr if path probing is disabled.
+			inline const Path * getPath() const noexcept {
+				return path.get();
+			}
+
+			/// @brief Get path MTU discovery.
+			/// @return The discovery state or nullptr if disabled.
+			inline const MTU * getMTU() const noexcept {
+				return mtu.get();
+			}
+
+			/// @brief Get probe statistics.
+			inline Statistics::Summary getStatistics() const noexcept {
+				return statistics.get();
+			}
+
+			/// @brief Seed the probe statistics with the ones of a previous run.
+			inline void restore(const Statistics::Summary &summary) noexcept {
+				statistics.restore(summary);
 			}
 
 			Value & getProperties(Value &value) const;
@@ -88,6 +403,39 @@
 
 		};
 
+		/// @brief Answer to a probe of ICMP::ping().
+		struct Reply {
+			IP::Address address;			///< @brief The address probed.
+			Response response = invalid;	///< @brief The probe result, invalid if the probe wasn't sent.
+			IP::Address from;				///< @brief Sender of the answer, empty on timeout.
+			uint64_t rtt = 0;				///< @brief Round trip time (ns), zero if not answered.
+		};
+
+		/// @brief Options of ICMP::ping().
+		struct Options {
+			unsigned long timeout = 5000;					///< @brief Time to wait for each answer (ms).
+			unsigned long interval = 0;						///< @brief Time between retries (ms), zero for a single probe.
+			Worker::Priority priority = Worker::normal;		///< @brief Probe priority.
+		};
+
+		/// @brief Probe a list of addresses once.
+		/// @details The probes are sent by the same controller as the agents, probes to addresses
+		/// already being probed share their stream. Throws if the ICMP socket can't be opened.
+		/// @param addresses The addresses to probe.
+		/// @param count Number of addresses.
+		/// @param callback Called on the thread pool after the last answer or timeout, with
+		/// the replies in the order of the addresses.
+		UDJAT_API void ping(const IP::Address *addresses, size_t count, const std::function<void(std::vector<Reply> &replies)> &callback, const Options &options = Options{});
+
+		/// @brief Probe a list of addresses once.
+		inline void ping(const std::vector<IP::Address> &addresses, const std::function<void(std::vector<Reply> &replies)> &callback, const Options &options = Options{}) {
+			ping(addresses.data(),addresses.size(),callback,options);
+		}
+
+		/// @brief Probe a list of addresses once.
+		/// @return The replies, in the order of the addresses.
+		UDJAT_API std::future<std::vector<Reply>> ping(const std::vector<IP::Address> &addresses, const Options &options = Options{});
+
 		UDJAT_API Response ResponseFactory(const char *name);
 
 		class UDJAT_API State : public Abstract::State {
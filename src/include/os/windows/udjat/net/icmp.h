@@ -37,7 +37,8 @@
 			destination_unreachable,
 			time_exceeded,
 			timeout,
-			network_unreachable
+			network_unreachable,
+			mtu_reduced
 		};
 
 		class UDJAT_API Worker : Win32::Handler {
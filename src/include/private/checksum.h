@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <cstddef>
+ #include <cstdint>
+
+ namespace Udjat {
+
+	/// @brief Internet checksum (RFC 1071).
+	/// @details Values are in the memory byte order, they can be stored in the packet as is.
+	namespace Checksum {
+
+		/// @brief Compute the checksum of a buffer.
+		/// @details Uses the best vector unit available on the CPU (AVX2, SSE2 or NEON),
+		/// selected on the first call.
+		uint16_t get(const void *data, size_t length) noexcept;
+
+		/// @brief Compute the checksum with an implementation, to compare them.
+		/// @param engine The implementation name ('avx2', 'sse2', 'neon' or 'generic').
+		/// @param checksum Set to the checksum of the buffer.
+		/// @return false if the implementation isn't built in or can't run on this CPU.
+		bool get(const char *engine, const void *data, size_t length, uint16_t &checksum) noexcept;
+
+		/// @brief Update a checksum after changing part of the packet (RFC 1624).
+		/// @param checksum The checksum of the packet before the change.
+		/// @param from The original contents of the changed region.
+		/// @param to The new contents of the changed region.
+		/// @param length The length of the region, it must start at an even offset of the packet;
+		/// the odd byte of an odd length is the first of a word, as in get().
+		/// @return The checksum of the changed packet.
+		uint16_t update(uint16_t checksum, const void *from, const void *to, size_t length) noexcept;
+
+		/// @brief Name of the implementation selected for this CPU.
+		const char * engine() noexcept;
+
+	}
+
+ }
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+
+ #include <config.h>
+ #include <udjat/net/ip/address.h>
+ #include <udjat/net/icmp.h>
+ #include <vector>
+ #include <functional>
+ #include <atomic>
+ #include <mutex>
+ #include <condition_variable>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	namespace ICMP {
+
+		/// @brief Probe results queued under a controller lock, delivered to the workers outside it.
+		/// @details Agent updates can be slow, running them outside the lock keeps them from stalling
+		/// packet processing and the other workers. A worker being removed drops its results with
+		/// drop() and waits with wait() for a notification in progress on another thread.
+		class Delivery {
+		private:
+
+			/// @brief The controller lock.
+			mutex &guard;
+
+			/// @brief Name of the controller on the log messages.
+			const char *name;
+
+			/// @brief Does the controller still own the worker? Called with the lock held.
+			const std::function<bool(const ICMP::Worker &worker)> owns;
+
+			struct Result {
+				ICMP::Worker *worker;
+				ICMP::Response response;
+				IP::Address from;
+			};
+
+			/// @brief Results queued by the controller, swapped out by deliver().
+			vector<Result> results;
+
+			/// @brief Batch being delivered, keeps the allocated space between calls.
+			vector<Result> delivered;
+
+			/// @brief Serializes deliver(), one batch at a time per controller.
+			mutex delivery;
+
+			/// @brief Worker being notified by deliver(), wait() waits for it.
+			atomic<const ICMP::Worker *> notifying{nullptr};
+
+			/// @brief Signaled when deliver() is done notifying a worker.
+			condition_variable notified;
+
+			/// @brief Protects the wait for 'notifying'.
+			mutex waiting;
+
+		public:
+			Delivery(mutex &guard, const char *name, const std::function<bool(const ICMP::Worker &worker)> &owns);
+
+			/// @brief Queue result for the worker, the lock must be held.
+			inline void post(ICMP::Worker &worker, const ICMP::Response response, const sockaddr_storage &from) {
+				results.push_back(Result{&worker,response,from});
+			}
+
+			/// @brief Are there results to deliver? The lock must be held.
+			inline bool pending() const noexcept {
+				return !results.empty();
+			}
+
+			/// @brief Drop the undelivered results of the worker, the lock must be held.
+			void drop(const ICMP::Worker &worker) noexcept;
+
+			/// @brief Wait for a notification of the worker running on another thread, the lock must NOT be held.
+			/// @details Returns right away when called from the notification itself (stop() called from set()).
+			void wait(const ICMP::Worker &worker);
+
+			/// @brief Notify the workers with the queued results, the lock must NOT be held.
+			void deliver();
+
+		};
+
+	}
+
+ }
@@ -20,11 +20,23 @@
  #pragma once
 
  #include <config.h>
+ #include <private/linux/delivery.h>
  #include <udjat/tools/timer.h>
  #include <udjat/tools/handler.h>
  #include <udjat/net/ip/address.h>
  #include <udjat/net/icmp.h>
- #include <list>
+ #include <vector>
+ #include <queue>
+ #include <unordered_map>
+ #include <functional>
+ #include <atomic>
+ #include <mutex>
+ #include <condition_variable>
+ #include <memory>
+ #include <cstddef>
+ #include <sys/socket.h>
+ #include <netinet/ip_icmp.h>
+ #include <netinet/icmp6.h>
 
  using namespace std;
 
@@ -35,54 +47,573 @@
 
 		#pragma pack(1)
 		/// @brief ICMP payload.
+		/// @details Replies are matched by slot id and token, a stale reply for a reused slot
+		/// carries a different token and is ignored.
 		struct Payload {
-			uint16_t	id;
-			uint16_t	seq;
-			uint64_t	time;
+			uint32_t	id;			///< @brief Host slot.
+			uint32_t	token;		///< @brief Host token, unique for every insert on the shard.
+			uint16_t	seq;		///< @brief Probe sequence of the host.
+			uint64_t	time;		///< @brief Send time (ns).
+			uint8_t		ttl;		///< @brief TTL of a path probe, zero for the host probe.
+			uint16_t	mtu;		///< @brief IP size of a path MTU probe, zero for the host probe.
+			uint8_t		reserved;	///< @brief Zero, keeps the echo request an even number of bytes.
+		};
+
+		/// @brief ICMP echo request.
+		struct Packet {
+			struct icmp icmp;
+			struct Payload payload;
 		};
 		#pragma pack()
 
+		/// @brief Largest IP packet sent, the size of the shared padding.
+		static constexpr uint16_t largest = 9000;
+
+		/// @brief Get the time used for RTT measurement.
+		/// @details Uses CLOCK_MONOTONIC, setting the wall clock doesn't change the samples.
+		/// @return Time in nanoseconds.
 		static uint64_t getCurrentTime() noexcept;
 
+		/// @brief Convert a kernel socket timestamp (CLOCK_REALTIME) to the getCurrentTime() clock.
+		/// @return Time in nanoseconds, zero if the wall clock was set after the timestamp.
+		static uint64_t getCurrentTime(const struct timespec &timestamp) noexcept;
+
+		/// @brief Get the checksum of an echo request built from the model.
+		/// @details The model checksum is adjusted for the sequence and payload instead of
+		/// recomputed (RFC 1624), the zeroed padding of larger probes doesn't change it.
+		static uint16_t checksum(const Packet &model, const Packet &packet) noexcept;
+
+		/// @brief Get the monotonic time used for probe scheduling.
+		/// @return Time in milliseconds.
+		static uint64_t getMilliseconds() noexcept;
+
 	private:
 
-		recursive_mutex guard;
+		/// @brief Protects the host table, scheduler and socket batches.
+		/// @details Never held while calling the workers, see deliver().
+		mutex guard;
+
+		/// @brief Shard index.
+		const unsigned int index;
+
+		/// @brief ICMP echo id of this shard on raw sockets.
+		const uint16_t ident;
+
+		/// @brief Process input on the thread pool, shards run in parallel.
+		const bool threaded;
+
+		/// @brief Is the socket an unprivileged ICMP datagram socket?
+		/// @details Datagram sockets receive only replies to this socket, without the IP header;
+		/// raw sockets need CAP_NET_RAW and a socket filter to drop foreign packets.
+		bool datagram = false;
+
+		/// @brief Attach socket filter dropping foreign ICMP packets on raw socket.
+		void filter() noexcept;
 
 		struct Host {
 
-#if __cplusplus >= 201703L			
-			ICMP::Worker &worker;
-			Host(ICMP::Worker &worker);
-#else
-			std::shared_ptr<ICMP::Worker> worker;
-			Host(std::shared_ptr<ICMP::Worker>worker);
-#endif // C++17
+			ICMP::Worker *worker = nullptr;		///< @brief The worker, nullptr when the slot is available.
+
+			Controller *controller = nullptr;	///< @brief The controller owning this slot.
+
+			uint32_t id = 0;
+
+			uint32_t token = 0;			///< @brief Token of the current insert, see Payload::token.
+
+			uint16_t packets = 0;		///< @brief Sequence of the last probe.
 
-			uint16_t id;
+			uint64_t timeout = 0;		///< @brief Response deadline (ms).
+			uint64_t next = 0;			///< @brief Time of the next probe (ms).
+			uint64_t scheduled = 0;		///< @brief Deadline queued on the scheduler (ms).
+			uint64_t sent = 0;			///< @brief Kernel transmit time of the last probe (ns), zero if unknown.
 
-			time_t timeout;
-			uint16_t packets = 0;
-			time_t next = 0;
+			bool answered = false;		///< @brief Was the last probe answered?
+			uint64_t backoff = 0;		///< @brief Current adaptive interval (ms), zero to restart from the worker interval.
+			uint64_t srtt = 0;			///< @brief Smoothed RTT (ns).
+			uint64_t rttvar = 0;		///< @brief RTT variation (ns).
 
-			bool onTimer();
-			void send() noexcept;
+			/// @brief Worker sharing the probes of the host, see share().
+			struct Subscriber {
+				ICMP::Worker *worker;
+				uint16_t delta;			///< @brief Host sequence minus the worker sequence.
+			};
 
-			inline bool operator ==(const ICMP::Worker &worker) const noexcept {
-				return &worker == &this->worker;
+			/// @brief Other workers probing the same target, the results are fanned out to them.
+			vector<Subscriber> subscribers;
+
+			inline bool active() const noexcept {
+				return worker != nullptr;
+			}
+
+			/// @brief Get the time this host needs attention.
+			inline uint64_t deadline() const noexcept {
+				return next <= timeout ? next : (timeout+1);
 			}
 
+			/// @brief Queue result for the worker and the subscribers.
+			void post(const ICMP::Response response, const sockaddr_storage &from);
+
+			/// @brief Count a reply on the statistics of the worker and the subscribers.
+			/// @param seq The host probe sequence.
+			void received(uint16_t seq, uint64_t rtt) noexcept;
+
+			/// @brief Postpone the next probe, keeping the reply deadline after it.
+			void defer(uint64_t when) noexcept;
+
+			/// @brief Check timeout, send probe if due.
+			/// @return false if the host has timed out and can be removed.
+			bool onTimer(uint64_t now);
+
+			/// @brief Queue a probe and set the time of the next one.
+			void send(uint64_t now) noexcept;
+
 			/// @brief Process response.
+			/// @param time Time the response was received (ns).
 			/// @return true if the response was processed and host can be removed.
-			bool onResponse(int icmp_type, const sockaddr_storage &addr, const Controller::Payload &payload) noexcept;
+			bool onResponse(int icmp_type, const sockaddr_storage &addr, const Controller::Payload &payload, uint64_t time) noexcept;
 
 			/// @brief Process ICMP error
 			bool onError(int code, const Controller::Payload &payload);
 
+			/// @brief Process the answer to an UDP probe.
+			/// @param code Zero for a reply from the service, the error queue errno otherwise
+			/// (ECONNREFUSED when the host reports port unreachable).
+			/// @return true if the host can be removed.
+			bool onDatagram(int code, const sockaddr_storage &from, const Controller::Payload &payload, uint64_t time) noexcept;
+
+			/// @brief Schedule the next probe of an adaptive host after a reply.
+			/// @param rtt The round trip time (ns), zero if the sample was dropped.
+			/// @param latest Is the reply for the last probe sent?
+			/// @return false if the host isn't adaptive and can be removed.
+			bool adapt(uint64_t rtt, bool latest) noexcept;
+
+		};
+
+		/// @brief In-flight hosts, indexed by the payload id.
+		/// @details Slot 'n' holds the host whose probes carry Payload::id == n, replies and
+		/// send errors are matched by index instead of scanning every active host.
+		vector<Host> hosts;
+
+		/// @brief Released slots, reused before the table grows.
+		vector<uint32_t> available;
+
+		/// @brief Number of active slots in the table.
+		size_t active = 0;
+
+		/// @brief Last token assigned, starts at a random point so a restarted shard doesn't
+		/// match replies to the probes of the previous one.
+		uint32_t tokens;
+
+		/// @brief Get the active host on a slot.
+		/// @return The host or nullptr if the slot is not in use.
+		inline Host * find(uint32_t id) noexcept {
+			if(id < hosts.size() && hosts[id].active()) {
+				return &hosts[id];
+			}
+			return nullptr;
+		}
+
+		/// @brief Get the active host owning a payload.
+		/// @return The host or nullptr if the payload is not from the current insert of the slot.
+		inline Host * find(const Payload &payload) noexcept {
+			Host *host = find(payload.id);
+			if(host && host->token == payload.token) {
+				return host;
+			}
+			return nullptr;
+		}
+
+		/// @brief Release host slot, the worker and the subscribers are no longer busy.
+		void release(Host &host) noexcept;
+
+		/// @brief Shared probe streams, hash of the target to the host slot.
+		/// @details Entries are not removed when the worker address changes, stale
+		/// ones are detected by comparing the host worker and dropped by share().
+		unordered_multimap<uint32_t,uint32_t> streams;
+
+		/// @brief Can other workers share the probes of this one?
+		static inline bool shareable(const ICMP::Worker &worker) noexcept {
+			return worker.method == Worker::icmp_echo && !worker.path && !worker.mtu;
+		}
+
+		/// @brief Subscribe the worker to a host already probing the same target.
+		/// @details Echo probes with the same address, timers, size and priority are sent
+		/// once; path and path MTU probes are per worker and never shared.
+		/// @return false if there's no such host, the worker needs its own slot.
+		bool share(ICMP::Worker &worker);
+
+		/// @brief Hand the host over to the first subscriber, the lock must be held.
+		void promote(Host &host);
+
+		/// @brief Worker request, queued by insert() and remove().
+		struct Command {
+			enum Action : uint8_t {
+				insert,
+				remove
+			} action;
+			ICMP::Worker *worker;
+			Command *next = nullptr;
+		};
+
+		/// @brief Pending commands, newest first (lock-free multi-producer stack).
+		atomic<Command *> commands{nullptr};
+
+		/// @brief Is a job to execute the pending commands already queued on the thread pool?
+		atomic<bool> pending{false};
+
+		/// @brief Is the socket open?
+		atomic<bool> listening{false};
+
+		/// @brief Queue a command without locking.
+		void push(Command::Action action, ICMP::Worker &worker);
+
+		/// @brief Execute the pending commands in arrival order, the lock must be held.
+		void execute();
+
+		/// @brief Add worker to the host table and queue its first probe, the lock must be held.
+		void attach(ICMP::Worker &worker);
+
+		/// @brief Remove worker from the host table and drop its undelivered results, the lock must be held.
+		void detach(ICMP::Worker &worker);
+
+		/// @brief Results waiting to be delivered to the workers outside the lock.
+		Delivery delivery{guard,"ICMP",[this](const ICMP::Worker &worker) {
+			return worker.controller == this;
+		}};
+
+		/// @brief Queue result for the worker, the lock must be held.
+		inline void post(ICMP::Worker &worker, const ICMP::Response response, const sockaddr_storage &from) {
+			delivery.post(worker,response,from);
+		}
+
+		/// @brief Notify the workers with the queued results, the lock must NOT be held.
+		inline void deliver() {
+			delivery.deliver();
+		}
+
+		/// @brief Scheduler entry.
+		struct Deadline {
+			uint64_t time;
+			uint32_t id;
+
+			inline bool operator>(const Deadline &d) const noexcept {
+				return time > d.time;
+			}
 		};
 
-		list<Host> hosts;
+		/// @brief Host deadlines, earliest first.
+		/// @details Entries are not removed when a host is released or rescheduled,
+		/// stale ones are detected by Host::scheduled and dropped when popped.
+		priority_queue<Deadline,vector<Deadline>,greater<Deadline>> deadlines;
+
+		/// @brief Time of the armed wakeup (ms), zero when the timer is idle.
+		uint64_t wakeup = 0;
 
-		Controller();
+		/// @brief Queue host deadline.
+		void schedule(Host &host);
+
+		/// @brief Arm the timer for the earliest deadline or disable it when idle.
+		void arm(uint64_t now);
+
+		/// @brief Egress token bucket, limits the probes sent by this shard.
+		/// @details Set by 'icmp-rate' (probes per second, 0 = unlimited) and 'icmp-burst'
+		/// on the 'network' configuration group, split between the shards.
+		struct Budget {
+
+			uint64_t rate = 0;			///< @brief Probes per second, zero when unlimited.
+			uint64_t capacity = 0;		///< @brief Bucket size (probes).
+			uint64_t tokens = 0;		///< @brief Available tokens, in thousandths of a probe.
+			uint64_t last = 0;			///< @brief Time of the last refill (ms).
+
+			void setup(uint64_t rate, uint64_t capacity) noexcept;
+
+			/// @brief Take a token.
+			/// @return false if the budget is exhausted.
+			bool take(uint64_t now) noexcept;
+
+			/// @brief Time until the next token (ms).
+			uint64_t wait() const noexcept;
+
+		} budget;
+
+		/// @brief Expired hosts of the current tick, reused between ticks.
+		vector<uint32_t> due;
+
+		/// @brief Process the expired deadlines, the lock must be held.
+		/// @details Hosts are served by priority; when the budget is exhausted their probes are
+		/// rescheduled for the next token, low priority probes are skipped while the scheduler lags.
+		void dispatch(uint64_t now);
+
+		/// @brief How late the last tick was (ms).
+		atomic<uint64_t> delay{0};
+
+		/// @brief Low priority probes skipped due to lag.
+		atomic<uint64_t> skipped{0};
+
+		/// @brief Receive batch, preallocated to drain the socket with recvmmsg.
+		struct Input {
+
+			/// @brief Number of packets received on each recvmmsg call.
+			static constexpr size_t length = 64;
+
+			/// @brief Size of each receive buffer.
+			static constexpr size_t size = 256;
+
+			struct mmsghdr msgs[length];
+			struct iovec iov[length];
+			struct sockaddr_storage addr[length];
+			uint8_t buffer[length][size];
+			uint8_t control[length][128];
+
+			Input() noexcept;
+
+			/// @brief Reset message headers before a new recvmmsg call.
+			void reset() noexcept;
+
+		} input;
+
+		/// @brief Receive statistics, written by the reader and read without the guard.
+		struct {
+			atomic<uint64_t> wakeups{0};	///< @brief Number of input events handled.
+			atomic<uint64_t> packets{0};	///< @brief Number of packets received.
+			atomic<size_t> last{0};			///< @brief Packets received on the last wakeup.
+			atomic<size_t> max{0};			///< @brief Largest number of packets received on a single wakeup.
+
+			/// @brief Account for a wakeup that received count packets.
+			/// @return The number of wakeups, including this one.
+			inline uint64_t update(size_t count) noexcept {
+				packets.fetch_add(count,std::memory_order_relaxed);
+				last.store(count,std::memory_order_relaxed);
+				if(count > max.load(std::memory_order_relaxed)) {
+					max.store(count,std::memory_order_relaxed);
+				}
+				return wakeups.fetch_add(1,std::memory_order_relaxed) + 1;
+			}
+
+		} received;
+
+		/// @brief Transmit batch, packets queued by send() until the next flush().
+		struct Output {
+
+			/// @brief Prebuilt echo request, copied for every queued probe.
+			Packet model;
+
+			/// @brief Last echo sequence sent.
+			uint16_t sequence = 0;
+
+			vector<Packet> packets;
+			vector<sockaddr_storage> addr;
+
+			/// @brief Length of each message, larger ones are padded from a shared zeroed buffer.
+			vector<uint16_t> lengths;
+
+			vector<struct mmsghdr> msgs;
+			vector<struct iovec> iov;
+
+			/// @brief Ancillary data setting the TTL of path probes.
+			struct Control {
+				uint8_t buffer[CMSG_SPACE(sizeof(int))];
+			};
+			vector<Control> control;
+
+			/// @brief Offset of the data sent from each packet, UDP probes send only the payload.
+			const size_t offset;
+
+			Output(size_t o = 0) : offset{o} {
+			}
+
+			inline bool empty() const noexcept {
+				return packets.empty();
+			}
+
+			void clear() noexcept;
+
+		} output;
+
+		/// @brief UDP probe socket.
+		/// @details Probes are bare payloads sent from one unconnected socket; with IP_RECVERR the
+		/// kernel queues the ICMP errors they trigger, with the original payload, on the error queue.
+		/// One connected socket per probe would get the errors without the error queue, but it costs
+		/// a descriptor and a main loop watch per host and defeats the sendmmsg batches; the single
+		/// socket keeps UDP probes on the same scale as the ICMP ones. Its pending socket error, set
+		/// by every ICMP error received, is handled by flush().
+		struct UDP : public MainLoop::Handler {
+
+			Controller &controller;
+
+			/// @brief Transmit batch.
+			Output output{offsetof(Packet,payload)};
+
+			UDP(Controller &c) : MainLoop::Handler(-1, MainLoop::Handler::oninput), controller{c} {
+			}
+
+			/// @brief Open the socket, the controller lock must be held.
+			void start();
+
+			/// @brief Close the socket, the controller lock must be held.
+			void stop() noexcept;
+
+			void handle_event(const Event event) override;
+
+		} udp{*this};
+
+		/// @brief ICMPv6 socket, opened on the first probe to an IPv6 host.
+		/// @details IPv6 hosts share the host table, scheduler and sequence of the IPv4 ones; the
+		/// kernel always computes the ICMPv6 checksum (RFC 3542), on raw and datagram sockets.
+		struct ICMPv6 : public MainLoop::Handler {
+
+			Controller &controller;
+
+			/// @brief Is it an unprivileged ICMP datagram socket?
+			bool datagram = false;
+
+			/// @brief Transmit batch, the ICMPv6 header is stored just before the payload.
+			Output output{offsetof(Packet,payload) - sizeof(struct icmp6_hdr)};
+
+			ICMPv6(Controller &c) : MainLoop::Handler(-1, MainLoop::Handler::oninput), controller{c} {
+			}
+
+			/// @brief Open the socket, the controller lock must be held.
+			void start();
+
+			/// @brief Close the socket, the controller lock must be held.
+			void stop() noexcept;
+
+			/// @brief Queue an echo request, the controller lock must be held.
+			void send(const sockaddr_storage &addr, const Payload &payload, uint16_t length);
+
+			void handle_event(const Event event) override;
+
+		} icmp6{*this};
+
+		/// @brief Get the ICMP type and code equivalent to an ICMPv6 error.
+		/// @return false if the message can't answer an echo request.
+		static bool translate(uint8_t &type, uint8_t &code) noexcept;
+
+		/// @brief Send all queued packets with sendmmsg.
+		/// @details Packets rejected by the kernel are reported to the owning host.
+		void flush() noexcept;
+
+		/// @brief Send the packets of a batch.
+		void flush(Output &batch, int sock) noexcept;
+
+		/// @brief Can the send error be the pending error of an earlier packet?
+		static bool asynchronous(int code) noexcept;
+
+		/// @brief Send prepared messages with sendmmsg, reporting the rejected ones to their hosts.
+		void transmit(int sock, struct mmsghdr *msgs, const Packet *packets, size_t length) noexcept;
+
+		/// @brief Read and dispatch pending UDP answers and errors, the lock must be held.
+		void datagrams();
+
+		/// @brief UDP hosts, address and port to the host slot.
+		/// @details Services don't echo the payload, replies are matched by the sender.
+		unordered_multimap<uint64_t,uint32_t> services;
+
+		/// @brief Probes answered by the current UDP reply, reused between replies.
+		vector<Payload> matched;
+
+		/// @brief Get the key of an IPv4 address and port on the service index.
+		static inline uint64_t service(const sockaddr_in &addr, uint16_t port) noexcept {
+			return (((uint64_t) addr.sin_addr.s_addr) << 16) | port;
+		}
+
+		/// @brief Get the current probes of the UDP hosts at an address and port.
+		/// @details Several workers can probe the same service, each one gets the reply.
+		/// @param probes Cleared, then filled with one payload per host.
+		void match(const sockaddr_storage &from, vector<Payload> &probes) noexcept;
+
+		/// @brief Read pending packets in batches.
+		/// @param socket The ICMP or the ICMPv6 socket.
+		/// @param flags Zero to read replies, MSG_ERRQUEUE to read the socket error queue.
+		/// @return Number of packets read.
+		size_t drain(const MainLoop::Handler &socket, int flags);
+
+		/// @brief Read pending packets of the ICMP socket.
+		inline size_t drain(int flags) {
+			return drain(*this,flags);
+		}
+
+		/// @brief Process the answer to a host probe, release or reschedule the host.
+		void response(Host &host, int type, const sockaddr_storage &addr, const Payload &payload, uint64_t time);
+
+		/// @brief Process a received packet.
+		/// @param data The packet, starting with the IP header.
+		/// @param length The packet length.
+		/// @param addr The sender address.
+		/// @param time Time the packet was received (ns).
+		void receive(const uint8_t *data, size_t length, const sockaddr_storage &addr, uint64_t time);
+
+		/// @brief Process a packet received on the ICMPv6 socket, starting with the ICMPv6 header.
+		void receive6(const uint8_t *data, size_t length, const sockaddr_storage &addr, uint64_t time);
+
+		/// @brief Path probe, indexed by the echo sequence on the wire.
+		/// @details Time exceeded messages only carry the header of the original echo request,
+		/// the sequence is the only field to identify the probe.
+		struct Trace {
+			uint32_t id = 0;		///< @brief Host slot.
+			uint32_t token = 0;		///< @brief Host token.
+			uint64_t time = 0;		///< @brief Send time (ns).
+			uint8_t ttl = 0;		///< @brief Probe TTL, zero if not a path probe.
+			uint16_t mtu = 0;		///< @brief Probe size, zero if not a path MTU probe.
+		};
+
+		/// @brief Path and path MTU probes in flight, allocated on the first one.
+		vector<Trace> traces;
+
+		/// @brief Get the next echo sequence, recording the path and path MTU probes.
+		uint16_t sequence(const Payload &payload);
+
+		/// @brief Process a message embedding one of our echo requests (time exceeded, unreachable).
+		/// @param header The ICMP header of the message.
+		/// @param data The embedded IP header.
+		/// @param length Length of the embedded data.
+		void embedded(const struct icmp &header, const uint8_t *data, size_t length, const sockaddr_storage &from, uint64_t time);
+
+		/// @brief Process an error message answering one of our echo requests.
+		/// @details Errors for host probes are matched by the payload, when the message quotes it,
+		/// and reported to the host at once; path probes are matched by the sequence.
+		/// @param type ICMP type of the error (time exceeded or destination unreachable).
+		/// @param code ICMP code of the error.
+		/// @param mtu Next hop MTU of fragmentation needed errors, zero if not reported.
+		/// @param seq The echo sequence on the wire.
+		/// @param data The payload of the original echo request.
+		/// @param length Length of the payload quoted by the error, can be zero.
+		void original(uint8_t type, uint8_t code, uint16_t mtu, uint16_t seq, const uint8_t *data, size_t length, const sockaddr_storage &from, uint64_t time);
+
+		/// @brief Register the answer of a path probe.
+		/// @param seq The echo sequence on the wire.
+		void hop(uint16_t seq, const sockaddr_storage &from, uint64_t time);
+
+		/// @brief Register a fragmentation needed answer to a path MTU probe.
+		/// @param seq The echo sequence on the wire.
+		/// @param mtu The next hop MTU, zero if not reported.
+		void fragment(uint16_t seq, uint16_t mtu);
+
+		/// @brief Is DF set on the socket (IP_PMTUDISC_PROBE)?
+		bool dontfragment = false;
+
+		/// @brief Process a message from the socket error queue.
+		void error(const struct msghdr &msg, const uint8_t *data, size_t length);
+
+		/// @brief Read and dispatch pending packets, the lock must be held.
+		void read(const Event event);
+
+#ifdef HAVE_LIBURING
+		/// @brief io_uring backend, see private/linux/icmp_uring.h.
+		class Ring;
+
+		/// @brief The ring, created on the first start; nullptr if unavailable or disabled.
+		std::unique_ptr<Ring> ring;
+
+		/// @brief Is the socket handled by the ring instead of the main loop?
+		bool uring = false;
+
+		/// @brief The ring can't handle the socket, back to the main loop watch.
+		void fallback() noexcept;
+#endif // HAVE_LIBURING
+
+		Controller(unsigned int index, bool threaded);
 
 		void start();
 		void stop();
@@ -92,17 +623,51 @@
 
 	public:
 
-		static Controller & getInstance() {
-			static Controller instance;
-			return instance;
-		}
+		/// @brief Number of shards replacing 'icmp-shards', zero to use the configuration.
+		/// @details Read by the first getInstance(), set it before starting any probe.
+		static unsigned int shards;
+
+		/// @brief Get the controller shard owning an address.
+		/// @details The number of shards is set by 'icmp-shards' on the 'network' configuration
+		/// group (0 = one per core, defaults to 1); each shard has its own socket, echo id and host table.
+		static Controller & getInstance(const sockaddr_storage &addr);
 
 		~Controller();
 
-		void insert(ICMP::Worker &host);
-		void remove(ICMP::Worker &host);
+		/// @brief Start probing the worker.
+		/// @details Once the socket is open it doesn't wait for the controller lock, the
+		/// worker is queued and added to the host table by a thread pool job.
+		void insert(ICMP::Worker &worker);
+
+		/// @brief Stop probing the worker.
+		/// @details On return the controller holds no reference to the worker
+		/// and no notification for it is running on another thread.
+		void remove(ICMP::Worker &worker);
+
+		/// @brief Queue an echo request, it will be sent on the next flush.
+		/// @param length Length of the ICMP message, zero for the smallest.
+		void send(const sockaddr_storage &addr, const Payload &payload, uint16_t length = 0);
 
-		void send(const sockaddr_storage &addr, const Payload &payload);
+		/// @brief Queue UDP probe.
+		/// @param port Destination port.
+		void send(const sockaddr_storage &addr, uint16_t port, const Payload &payload);
+
+		/// @brief Get the scheduler lag.
+		/// @return How late the last expired deadline was served (ms).
+		inline uint64_t lag() const noexcept {
+			return delay.load();
+		}
+
+		/// @brief Get the number of low priority probes skipped due to lag.
+		inline uint64_t deferred() const noexcept {
+			return skipped.load();
+		}
+
+		/// @brief Get the average number of packets received per wakeup.
+		inline double packets_per_wakeup() const noexcept {
+			uint64_t wakeups = received.wakeups.load(std::memory_order_relaxed);
+			return wakeups ? (((double) received.packets.load(std::memory_order_relaxed)) / ((double) wakeups)) : 0;
+		}
 
 	};
 
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+
+ #include <config.h>
+ #include <private/linux/icmp_controller.h>
+
+ #ifdef HAVE_LIBURING
+
+ #include <liburing.h>
+ #include <memory>
+ #include <vector>
+
+ namespace Udjat {
+
+	/// @brief io_uring backend of the ICMP socket.
+	/// @details Replies arrive through a multishot recvmsg on a provided buffer ring and the error
+	/// queue through a multishot poll, completions are signaled on an eventfd watched by the main
+	/// loop; send batches are queued as one sendmsg SQE per probe and submitted at once.
+	class ICMP::Controller::Ring : public MainLoop::Handler {
+	private:
+
+		Controller &controller;
+
+		struct io_uring uring;
+
+		/// @brief Was the ring set up?
+		bool ready = false;
+
+		/// @brief Submission queue size.
+		static constexpr unsigned int entries = 256;
+
+		/// @brief Provided receive buffers.
+		struct Buffers {
+			static constexpr unsigned int count = 256;		///< @brief Number of buffers, a power of 2.
+			static constexpr unsigned int size = 512;		///< @brief Size of each buffer.
+			static constexpr int group = 0;					///< @brief Buffer group id.
+			struct io_uring_buf_ring *ring = nullptr;
+			std::vector<uint8_t> memory;
+		} buffers;
+
+		/// @brief Name and control lengths of the multishot recvmsg.
+		struct msghdr header;
+
+		/// @brief Socket attached, -1 if none.
+		int sock = -1;
+
+		/// @brief Attach count, completions of a previous attach are ignored.
+		uint32_t generation = 0;
+
+		/// @brief Send batch owned by the kernel until every completion arrives.
+		Output sending;
+
+		/// @brief Sends without completion.
+		size_t inflight = 0;
+
+		/// @brief Send entries prepared but not yet accepted by io_uring_submit.
+		std::vector<struct io_uring_sqe *> queued;
+
+		enum Tag : uint32_t {
+			receive = 1,
+			errors = 2,
+			transmit = 3
+		};
+
+		static inline uint64_t tag(Tag t, uint32_t index) noexcept {
+			return (((uint64_t) t) << 32) | index;
+		}
+
+		Ring(Controller &controller);
+
+		/// @brief Get a submission entry, submitting the queue if full.
+		struct io_uring_sqe * sqe() noexcept;
+
+		bool arm(Tag t) noexcept;
+
+		/// @brief Submit the queued sends.
+		/// @param first Index of the first queued message, advanced past them when submitted.
+		/// @return false if the submission failed, the queued entries are then turned into no-ops.
+		bool submit(size_t &first) noexcept;
+
+		/// @brief Process completions, the controller lock must be held.
+		/// @return Number of packets received.
+		size_t process();
+
+		void handle_event(const Event event) override;
+
+	public:
+
+		/// @brief Set up the ring.
+		/// @return The ring or nullptr if the kernel doesn't support it.
+		static std::unique_ptr<Ring> create(Controller &controller) noexcept;
+
+		~Ring();
+
+		/// @brief Start receiving from the socket, the controller lock must be held.
+		/// @return false if the socket can't be handled by the ring.
+		bool attach(int sock) noexcept;
+
+		/// @brief Stop receiving from the socket, the controller lock must be held.
+		void detach() noexcept;
+
+		/// @brief Submit a send batch, the controller lock must be held.
+		/// @details The batch vectors are moved to the ring until the completions arrive.
+		/// @return false if the previous batch is still in flight, send it the usual way.
+		bool send(Output &batch, int sock) noexcept;
+
+	};
+
+ }
+
+ #endif // HAVE_LIBURING
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+ #pragma once
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/tools/timer.h>
+ #include <udjat/net/ip/agent.h>
+ #include <pugixml.hpp>
+ #include <unordered_map>
+ #include <vector>
+ #include <memory>
+ #include <string>
+ #include <mutex>
+ #include <cstdint>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	/// @brief Warm-start snapshot of the network agents.
+	/// @details The last ICMP responses, probe counters, addresses and DNS state of the agents are
+	/// saved every 'snapshot-interval' seconds and on module deinit to the file set by 'snapshot' on
+	/// the 'network' configuration group (disabled when empty). On start the agents are restored from
+	/// it, marked as stale until the first probe; records older than 'snapshot-max-age' are ignored.
+	class IP::Snapshot {
+	public:
+
+		/// @brief File header.
+		struct Header {
+			char magic[8];			///< @brief File identifier, see Snapshot::magic.
+			uint32_t version;		///< @brief File format version.
+			uint32_t size;			///< @brief Size of each record.
+			uint64_t count;			///< @brief Number of records.
+			uint64_t time;			///< @brief Time of the save (seconds since epoch).
+		};
+
+		/// @brief Agent state, the records are sorted by key.
+		struct Record {
+			uint64_t key = 0;			///< @brief Hash of the agent path, name and hostname.
+			uint64_t time = 0;			///< @brief Time the state was captured (seconds since epoch).
+			uint64_t sent = 0;			///< @brief Probes sent.
+			uint64_t received = 0;		///< @brief Replies received.
+			uint64_t duplicates = 0;	///< @brief Duplicated replies.
+			uint64_t reordered = 0;		///< @brief Replies received out of order.
+			uint64_t jitter = 0;		///< @brief RTT jitter (ns).
+			uint64_t last = 0;			///< @brief Last RTT (ns).
+			uint64_t min = 0;			///< @brief Minimum RTT on the window (ns).
+			uint64_t avg = 0;			///< @brief Average RTT on the window (ns).
+			uint64_t max = 0;			///< @brief Maximum RTT on the window (ns).
+			float loss = 0;				///< @brief Packet loss on the window (%).
+			int32_t dns = -1;			///< @brief Last DNS query result, -1 if not a DNS agent.
+			uint8_t family[2] = { 0, 0 };	///< @brief Address families of the address and of the IPv6 one.
+			uint8_t response[2] = { ICMP::invalid, ICMP::invalid };	///< @brief Last ICMP responses.
+			uint8_t address[2][16] = {};	///< @brief The address and the IPv6 one of dual-stack hosts.
+		};
+
+		static Snapshot & getInstance();
+
+		/// @brief Restore the agent state and keep it on the snapshot.
+		void insert(IP::Agent &agent);
+
+		/// @brief Capture the final state of the agent, it's going away.
+		void remove(IP::Agent &agent);
+
+		/// @brief Write the snapshot file, from the main loop thread.
+		void save();
+
+		/// @brief Save the last state of the agents and forget them, called on module deinit.
+		void stop();
+
+		/// @brief Get the hash of the names of the parent nodes of an agent.
+		static uint64_t path(const pugi::xml_node &node) noexcept;
+
+	private:
+
+		static constexpr const char magic[8] = { 'u', 'd', 'j', 'a', 't', 'n', 'e', 't' };
+		static constexpr uint32_t version = 2;
+
+		/// @brief Protects the records and the file mapping.
+		mutex guard;
+
+		/// @brief Serializes the writes of the file.
+		mutex writing;
+
+		/// @brief The snapshot file, empty if disabled.
+		const std::string filename;
+
+		/// @brief Records older than this are ignored (seconds).
+		const uint64_t age;
+
+		/// @brief Save interval (ms).
+		const unsigned long interval;
+
+		/// @brief Periodic save, running while there are agents.
+		class Timer : public MainLoop::Timer {
+		private:
+			Snapshot &snapshot;
+
+		protected:
+			void on_timer() override;
+
+		public:
+			Timer(Snapshot &snapshot);
+
+		};
+
+		std::unique_ptr<Timer> timer;
+
+		/// @brief Number of the last records collected and of the last ones written.
+		struct {
+			uint64_t collected = 0;
+			uint64_t written = 0;
+		} serial;
+
+		/// @brief The mapped snapshot file, read on the first insert or save; its records are moved to the entries on save.
+		struct {
+			bool loaded = false;
+			void *data = nullptr;
+			size_t length = 0;
+			const Header *header = nullptr;
+			const Record *records = nullptr;
+		} file;
+
+		struct Entry {
+			Record record;
+			IP::Agent *agent = nullptr;		///< @brief The agent, nullptr after it's gone.
+		};
+
+		/// @brief Agent states, kept after the agent is gone to be saved and restored on reload.
+		unordered_map<uint64_t,Entry> entries;
+
+		Snapshot();
+
+		/// @brief Map the snapshot file, the lock must be held.
+		void load() noexcept;
+
+		/// @brief Release the file mapping, the lock must be held.
+		void unload() noexcept;
+
+		/// @brief Get the record of a key from the snapshot file, the lock must be held.
+		/// @return The record or nullptr if not found.
+		const Record * find(uint64_t key) const noexcept;
+
+		/// @brief Get the snapshot key of an agent.
+		static uint64_t key(const IP::Agent &agent) noexcept;
+
+		/// @brief Update the record with the agent state, the lock must be held.
+		/// @details The addresses and the DNS state are set by the main loop, call it from there.
+		static void capture(Record &record, const IP::Agent &agent) noexcept;
+
+		/// @brief Set the agent state from the record, the lock must NOT be held.
+		static void restore(IP::Agent &agent, const Record &record);
+
+		/// @brief Capture the agents and get the records to save, the lock must NOT be held.
+		/// @details The records of the mapped file not on the entries are moved to them, the file is
+		/// released to be replaced.
+		/// @param number Set to the serial number of the records.
+		vector<Record> collect(uint64_t &number);
+
+		/// @brief Write the records to the snapshot file, unless newer ones were already written.
+		void write(vector<Record> &records, uint64_t number);
+
+	public:
+		~Snapshot();
+
+	};
+
+ }
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+
+ #include <config.h>
+ #include <private/linux/delivery.h>
+ #include <udjat/tools/timer.h>
+ #include <udjat/tools/handler.h>
+ #include <udjat/net/ip/address.h>
+ #include <udjat/net/icmp.h>
+ #include <vector>
+ #include <queue>
+ #include <functional>
+ #include <atomic>
+ #include <mutex>
+ #include <condition_variable>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	namespace TCP {
+
+		/// @brief Non blocking TCP connect probes, for hosts dropping ICMP.
+		/// @details Every connect in flight is registered on a single epoll descriptor watched by
+		/// the main loop; results are reported with the ICMP responses (connected = echo reply,
+		/// refused = echo reply too, the RST came from the host) and the connect time is recorded as the RTT.
+		class Controller : private MainLoop::Timer, private MainLoop::Handler {
+		private:
+
+			mutex guard;
+
+			struct Probe {
+				ICMP::Worker *worker = nullptr;		///< @brief The worker, nullptr when the slot is available.
+				int sock = -1;						///< @brief The connecting socket.
+				uint32_t token = 0;					///< @brief Token of the current connect.
+				uint16_t seq = 0;					///< @brief Statistics sequence of the connect.
+				uint64_t start = 0;					///< @brief Connect time (ns).
+				uint64_t timeout = 0;				///< @brief Connect deadline (ms).
+
+				inline bool active() const noexcept {
+					return worker != nullptr;
+				}
+			};
+
+			/// @brief Connects in flight, the epoll data has the slot and the token.
+			vector<Probe> probes;
+
+			/// @brief Released slots.
+			vector<uint32_t> available;
+
+			size_t active = 0;
+
+			uint32_t tokens = 0;
+
+			struct Deadline {
+				uint64_t time;
+				uint32_t id;
+				uint32_t token;
+
+				inline bool operator>(const Deadline &d) const noexcept {
+					return time > d.time;
+				}
+			};
+
+			/// @brief Connect deadlines, entries of finished connects are dropped when popped.
+			priority_queue<Deadline,vector<Deadline>,greater<Deadline>> deadlines;
+
+			/// @brief Time of the armed wakeup (ms), zero when idle.
+			uint64_t wakeup = 0;
+
+			/// @brief Results waiting to be delivered outside the lock.
+			ICMP::Delivery delivery{guard,"TCP",[this](const ICMP::Worker &worker) {
+				return worker.connector == this;
+			}};
+
+			Controller();
+
+			/// @brief Open the epoll descriptor, the lock must be held.
+			void start();
+
+			/// @brief Close the epoll descriptor, the lock must be held.
+			void stop();
+
+			/// @brief Finish connect, the lock must be held.
+			/// @param error Zero if connected, the socket error otherwise.
+			void finish(Probe &probe, int error, uint64_t time);
+
+			/// @brief Release slot and close the socket, the lock must be held.
+			void release(Probe &probe) noexcept;
+
+			/// @brief Arm the timer for the earliest deadline, the lock must be held.
+			void arm(uint64_t now);
+
+			/// @brief Notify workers, the lock must NOT be held.
+			inline void deliver() {
+				delivery.deliver();
+			}
+
+			void on_timer() override;
+			void handle_event(const Event event) override;
+
+		public:
+
+			static Controller & getInstance();
+
+			~Controller();
+
+			/// @brief Start a connect probe.
+			void insert(ICMP::Worker &worker);
+
+			/// @brief Cancel the probe, no notification for the worker is running on return.
+			void remove(ICMP::Worker &worker);
+
+		};
+
+	}
+
+ }
@@ -33,14 +33,18 @@
 		class UDJAT_API Agent : public IP::Agent {
 		private:
 
+			friend class IP::Snapshot;
+
 			struct {
 				IP::Address ip;											///< @brief The DNS server address.
 				const char * name = nullptr;							///< @brief The DNS Server to use.
 			} server;
 
 			const char * hostname = nullptr;							///< @brief The hostname to check (empty or nullptr to disable DNS test).
+			bool dualstack = false;										///< @brief Resolve and probe the IPv6 address too ('dual-stack')?
 			std::vector<std::shared_ptr<DNS::State>> states;			///< @brief XML defined DNS states.
 			std::shared_ptr<DNS::State> state;							///< @brief DNS state.
+			int code = -1;												///< @brief Result of the last query, -1 before the first one.
 
 		protected:
 
@@ -56,6 +60,7 @@
 
 			Agent(const char *name = "");
 			Agent(const pugi::xml_node &node);
+			~Agent();
 
 			/// @brief Do a DNS check
 			/// @return true if the state has changed.
@@ -25,17 +25,27 @@
  #include <udjat/net/icmp.h>
  #include <udjat/net/ip/state.h>
  #include <udjat/net/dns.h>
+ #include <memory>
+ #include <mutex>
 
  namespace Udjat {
 
 	namespace IP {
 
+		class Snapshot;
+
 		class UDJAT_API Agent : public Abstract::Agent, public ICMP::Worker  {
 		private:
 
+			friend class Snapshot;
+
+			/// @brief Protects the ICMP responses and state, set by the probes of both addresses.
+			mutable std::mutex guard;
+
 			struct {
 				bool check = true;											///< @brief Is ICMP check enabled?
 				Udjat::ICMP::Response response = Udjat::ICMP::invalid;		///< @brief ICMP Response.
+				Udjat::ICMP::Response family[2] = { Udjat::ICMP::invalid, Udjat::ICMP::invalid };	///< @brief Last response of the address and of the IPv6 one.
 				std::vector<std::shared_ptr<ICMP::State>> states;			///< @brief XML defined ICMP states.
 				std::shared_ptr<ICMP::State> state;							///< @brief ICMP state.
 			} icmp;
@@ -45,8 +55,38 @@
 				std::shared_ptr<Abstract::IP::State> state;					///< @brief IP state.
 			} ip;
 
+			/// @brief ICMP probe of the IPv6 address of a dual-stack host.
+			class Secondary : public ICMP::Worker {
+			private:
+				Agent &agent;
+
+			protected:
+				void set(const ICMP::Response response, const IP::Address &from) override;
+
+			public:
+				Secondary(Agent &agent, const pugi::xml_node &node, const char *addr);
+				~Secondary();
+
+				using ICMP::Worker::start;
+				using ICMP::Worker::stop;
+
+			};
+
+			/// @brief The IPv6 probe, started on the same refresh as the host one; nullptr if not dual-stack.
+			std::unique_ptr<Secondary> secondary;
+
+			/// @brief Update the ICMP state from the responses of both addresses, the lock must NOT be held.
+			void update();
+
 		protected:
 
+			/// @brief Warm-start snapshot, see IP::Snapshot.
+			struct {
+				uint64_t key = 0;		///< @brief Key of the agent on the snapshot, zero if not on it.
+				uint64_t time = 0;		///< @brief Time of the restored state (seconds since epoch), zero once probed.
+				uint64_t path = 0;		///< @brief Hash of the names of the parent nodes, zero if not built from XML.
+			} snapshot;
+
 			/// @brief Build and IP state from xml node.
 			std::shared_ptr<Abstract::State> StateFactory(const pugi::xml_node &node) override;
 
@@ -58,12 +98,17 @@
 
 			virtual void start() override;
 
+			/// @brief Set the IPv6 address of a dual-stack host.
+			/// @param addr The address, nullptr to stop probing it.
+			void setIPv6(const sockaddr_storage *addr);
+
 		public:
 
 			static std::shared_ptr<Abstract::Agent> Factory(const pugi::xml_node &node);
 
 			Agent(const char *name = "");
 			Agent(const pugi::xml_node &node, const char *ipaddr = "");
+			~Agent();
 
 			/// @brief Do an ICMP check
 			/// @return true if the state has changed.
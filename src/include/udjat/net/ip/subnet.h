@@ -58,6 +58,55 @@
 
 			std::string to_string() const noexcept;
 
+			/// @brief Iterator over the IPv4 host addresses of the subnet.
+			class UDJAT_API Iterator {
+			private:
+				uint64_t value;		///< @brief Address in host byte order, 64 bits to represent the end of 0.0.0.0/0.
+
+			public:
+				constexpr Iterator(uint64_t v) : value{v} {
+				}
+
+				Iterator(const sockaddr_in &addr);
+
+				inline Iterator & operator++() noexcept {
+					value++;
+					return *this;
+				}
+
+				inline bool operator==(const Iterator &it) const noexcept {
+					return value == it.value;
+				}
+
+				inline bool operator!=(const Iterator &it) const noexcept {
+					return value != it.value;
+				}
+
+				/// @brief Distance between iterators.
+				inline size_t operator-(const Iterator &it) const noexcept {
+					return (size_t) (value - it.value);
+				}
+
+				inline Iterator operator+(size_t offset) const noexcept {
+					return Iterator{value+offset};
+				}
+
+				sockaddr_in operator*() const noexcept;
+
+			};
+
+			/// @brief Get the first host address.
+			/// @details The network and broadcast addresses are skipped, except on /31 and /32 subnets.
+			Iterator begin() const;
+
+			/// @brief Get the end of the host addresses.
+			Iterator end() const;
+
+			/// @brief Get the number of host addresses.
+			inline size_t size() const {
+				return end() - begin();
+			}
+
 			static bool for_each(const std::function<bool(const SubNet &subnet)> &method);
 
 		};
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #pragma once
+ #include <udjat/defs.h>
+ #include <udjat/agent.h>
+ #include <udjat/tools/timer.h>
+ #include <udjat/net/ip/subnet.h>
+ #include <udjat/net/icmp.h>
+ #include <vector>
+ #include <memory>
+ #include <mutex>
+
+ namespace Udjat {
+
+	namespace IP {
+
+		/// @brief Agent pinging every host address of a subnet, the value is the number of live hosts.
+		/// @details Probes are sent at 'rate' addresses per second by a small pool of ICMP workers,
+		/// liveness is kept in bitmaps instead of per-host agents.
+		class UDJAT_API Sweep : public Udjat::Agent<unsigned int>, private MainLoop::Timer {
+		private:
+
+			/// @brief Worker probing one address at a time.
+			class Probe : public ICMP::Worker {
+			private:
+				Sweep &sweep;
+
+			protected:
+				void set(const ICMP::Response response, const IP::Address &from) override;
+
+			public:
+				size_t index = 0;		///< @brief Bitmap index of the address being probed.
+
+				Probe(Sweep &sweep, const ICMP::Worker::Timers &timers);
+
+				inline void start() {
+					ICMP::Worker::start();
+				}
+
+				inline void stop() {
+					ICMP::Worker::stop();
+				}
+
+			};
+
+			mutable std::mutex guard;
+
+			IP::SubNet subnet;
+
+			/// @brief First host address of the subnet.
+			IP::SubNet::Iterator first{0};
+
+			/// @brief Number of host addresses on the subnet.
+			size_t length = 0;
+
+			/// @brief Addresses per second.
+			unsigned int rate;
+
+			const ICMP::Worker::Timers timers;
+
+			std::vector<std::unique_ptr<Probe>> probes;
+
+			/// @brief Probes not in flight.
+			std::vector<Probe *> idle;
+
+			/// @brief Liveness bitmaps, one bit per address.
+			struct {
+				std::vector<uint64_t> alive;	///< @brief Address answered the last probe.
+				std::vector<uint64_t> known;	///< @brief Address was probed at least once.
+			} bitmap;
+
+			struct {
+				size_t alive = 0;			///< @brief Addresses answering.
+				size_t known = 0;			///< @brief Addresses probed at least once.
+				unsigned int passes = 0;	///< @brief Complete sweeps of the subnet.
+			} count;
+
+			/// @brief Next address to probe, 'length' when the pass is complete.
+			size_t next = 0;
+
+			/// @brief Is a pass running?
+			bool running = false;
+
+			/// @brief Probe credit, in thousandths of a probe.
+			uint64_t credit = 0;
+
+			/// @brief Time of the last tick (ms).
+			uint64_t last = 0;
+
+			/// @brief Start a new pass if idle.
+			void begin();
+
+			/// @brief Register the result of a probe.
+			void complete(Probe &probe, bool alive);
+
+			/// @brief Send the probes allowed by the rate.
+			void on_timer() override;
+
+			static inline bool test(const std::vector<uint64_t> &bitmap, size_t index) noexcept {
+				return (bitmap[index >> 6] >> (index & 0x3F)) & 1;
+			}
+
+		public:
+
+			Sweep(const pugi::xml_node &node);
+			virtual ~Sweep();
+
+			void start() override;
+			void stop() override;
+
+			/// @brief Start a new pass if the previous one has finished.
+			bool refresh() override;
+
+			Udjat::Value & getProperties(Value &value) const override;
+
+			/// @brief Get the state of an address, the path is the address.
+			bool getProperties(const char *path, Value &value) const override;
+
+		};
+
+	}
+
+ }
@@ -31,6 +31,7 @@
 
 #ifndef _WIN32
   #include <netdb.h>
+  #include <private/linux/snapshot.h>
 #endif // _WIN32
 
  using namespace std;
@@ -43,6 +44,16 @@
 	DNS::Agent::Agent(const pugi::xml_node &node) : IP::Agent{node} {
 		server.name = String(node,"dns","").as_quark();
 		hostname = String(node,"hostname","").as_quark();
+		dualstack = getAttribute(node,"dual-stack",false);
+	}
+
+	DNS::Agent::~Agent() {
+#ifndef _WIN32
+		// Capture the DNS state while it's still here.
+		if(snapshot.key) {
+			IP::Snapshot::getInstance().remove(*this);
+		}
+#endif // _WIN32
 	}
 
 	std::shared_ptr<Abstract::State> DNS::Agent::computeState() {
@@ -102,6 +113,8 @@
 
 	bool DNS::Agent::set(int code, const char *name) {
 
+		this->code = code;
+
 		if(state && state->compare(code)) {
 			debug("DNS State not changed");
 			return false;
@@ -151,36 +164,79 @@
 
 			}
 
-			// Using a custom DNS server?
-			if(server.ip) {
+			// The families are resolved independently, a dual-stack host can have only one of them.
+			int failed = 0;
+			bool resolved = false;		// Got the IPv6 address?
+
+			try {
 
-				DNS::Resolver resolver{server.ip};
+				DNS::Resolver resolver;
+				if(server.ip) {
+					resolver.set(server.ip);
+				}
 				resolver.query(hostname);
+
 				if(resolver.empty()) {
 					IP::Address::clear();
 #ifdef _WIN32
 					#warning Implement
 #else
-					set(HOST_NOT_FOUND,server.name);
+					failed = HOST_NOT_FOUND;
 #endif // _WIN32
+				} else {
+					IP::Address::set(resolver.begin()->getAddr());
 				}
 
-				IP::Address::set(resolver.begin()->getAddr());
+			} catch(const DNS::Exception &e) {
 
-			} else {
+				if(!dualstack) {
+					throw;
+				}
 
-				DNS::Resolver resolver;
-				resolver.query(hostname);
-				if(resolver.empty()) {
-					IP::Address::clear();
-#ifdef _WIN32
-					#warning Implement
-#else
-					set(HOST_NOT_FOUND,server.name);
-#endif // _WIN32
+				// Keep looking for the AAAA record.
+				Logger::String{"A query has failed: ",e.what()," (",e.code(),")"}.trace(name());
+				IP::Address::clear();
+				failed = e.code();
+
+			}
+
+			if(dualstack) {
+
+				// The IPv6 address is optional, no AAAA record stops probing it.
+				try {
+
+					DNS::Resolver resolver;
+					if(server.ip) {
+						resolver.set(server.ip);
+					}
+					resolver.query(ns_c_in,ns_t_aaaa,hostname,false);
+
+					for(const auto &record : resolver) {
+						if(record.getType() == ns_t_aaaa) {
+							setIPv6(&record.getAddr());
+							resolved = true;
+							break;
+						}
+					}
+
+				} catch(const DNS::Exception &e) {
+
+					Logger::String{"AAAA query has failed: ",e.what()," (",e.code(),")"}.trace(name());
+
+				}
+
+				if(!resolved) {
+					setIPv6(nullptr);
 				}
 
-				IP::Address::set(resolver.begin()->getAddr());
+			}
+
+			if(failed && !resolved) {
+
+				// No address of any family.
+				server.ip.clear();
+				return set(failed,hostname);
+
 			}
 
 #ifdef _WIN32
@@ -193,6 +249,7 @@
 
 			server.ip.clear();
 			IP::Address::clear();
+			setIPv6(nullptr);
 
 			Logger::String{"DNS Query has failed: ",e.what()," (",e.code(),")"}.trace(name());
 			return set(e.code(),hostname);
@@ -56,11 +56,18 @@
 		int rdlen 		= ns_rr_rdlen(rr);
 		const unsigned char * rdata	= ns_rr_rdata(rr);
 
+		memset(&addr,0,sizeof(addr));
+
+		if (rdlen == (size_t) NS_IN6ADDRSZ) {
+			addr.ss_family = AF_INET6;
+			memcpy(&((struct sockaddr_in6 *) &addr)->sin6_addr,rdata,NS_IN6ADDRSZ);
+			return;
+		}
+
 		if (rdlen != (size_t) NS_INADDRSZ) {
 			throw runtime_error("RR format error");
 		}
 
-		memset(&addr,0,sizeof(addr));
 		addr.ss_family = AF_INET;
 
 		((struct sockaddr_in *) &addr)->sin_addr.s_addr = ((struct in_addr *) rdata)->s_addr;
@@ -80,6 +87,7 @@
 		#pragma GCC diagnostic ignored "-Wswitch"
 		switch(this->type) {
 		case ns_t_a:
+		case ns_t_aaaa:
 			getValue(msg,rr,this->addr);
 			if(this->value.empty()) {
 				this->value = std::to_string(this->addr);
@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * The ones' complement sum doesn't depend on the word size or on the byte order (RFC 1071),
+  * every engine adds the buffer as wide native words and folds the result to 16 bits.
+  */
+
+ #include <config.h>
+ #include <private/checksum.h>
+ #include <cstring>
+
+ #if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define HAVE_CHECKSUM_X86 1
+ #elif defined(__ARM_NEON) && defined(__aarch64__)
+	#include <arm_neon.h>
+	#define HAVE_CHECKSUM_NEON 1
+ #endif
+
+ namespace Udjat {
+
+	/// @brief Fold a 64 bit sum to 16 bits.
+	static inline uint16_t fold(uint64_t sum) noexcept {
+		sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+		sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+		sum = (sum >> 16) + (sum & 0xFFFF);
+		sum = (sum >> 16) + (sum & 0xFFFF);
+		return (uint16_t) sum;
+	}
+
+	/// @brief Add the bytes not handled by the vector loop.
+	static inline uint64_t tail(uint64_t sum, const uint8_t *ptr, size_t length) noexcept {
+
+		while(length >= 4) {
+			uint32_t word;
+			memcpy(&word,ptr,4);
+			sum += word;
+			ptr += 4;
+			length -= 4;
+		}
+
+		if(length >= 2) {
+			uint16_t word;
+			memcpy(&word,ptr,2);
+			sum += word;
+			ptr += 2;
+			length -= 2;
+		}
+
+		if(length) {
+			// Odd byte, padded with zero as the first byte of a word.
+			uint16_t word = 0;
+			*((uint8_t *) &word) = *ptr;
+			sum += word;
+		}
+
+		return sum;
+	}
+
+	/// @brief Portable engine, 64 bit accumulator of 32 bit words.
+	static uint64_t generic(const uint8_t *ptr, size_t length) noexcept {
+		return tail(0,ptr,length);
+	}
+
+ #ifdef HAVE_CHECKSUM_X86
+
+	/// @brief Lanes added before folding the 32 bit accumulators, keeps them from overflowing.
+	static constexpr size_t block = 0x8000;
+
+	__attribute__((target("sse2")))
+	static uint64_t sse2(const uint8_t *ptr, size_t length) noexcept {
+
+		const __m128i zero = _mm_setzero_si128();
+		uint64_t sum = 0;
+
+		while(length >= 16) {
+
+			__m128i acc = zero;
+			size_t count = 0;
+
+			while(length >= 16 && count < block) {
+				__m128i data = _mm_loadu_si128((const __m128i *) ptr);
+				acc = _mm_add_epi32(acc,_mm_unpacklo_epi16(data,zero));
+				acc = _mm_add_epi32(acc,_mm_unpackhi_epi16(data,zero));
+				ptr += 16;
+				length -= 16;
+				count++;
+			}
+
+			uint32_t lanes[4];
+			_mm_storeu_si128((__m128i *) lanes,acc);
+			sum += ((uint64_t) lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+
+		}
+
+		return tail(sum,ptr,length);
+	}
+
+	__attribute__((target("avx2")))
+	static uint64_t avx2(const uint8_t *ptr, size_t length) noexcept {
+
+		const __m256i zero = _mm256_setzero_si256();
+		uint64_t sum = 0;
+
+		while(length >= 32) {
+
+			__m256i acc = zero;
+			size_t count = 0;
+
+			while(length >= 32 && count < block) {
+				__m256i data = _mm256_loadu_si256((const __m256i *) ptr);
+				acc = _mm256_add_epi32(acc,_mm256_unpacklo_epi16(data,zero));
+				acc = _mm256_add_epi32(acc,_mm256_unpackhi_epi16(data,zero));
+				ptr += 32;
+				length -= 32;
+				count++;
+			}
+
+			uint32_t lanes[8];
+			_mm256_storeu_si256((__m256i *) lanes,acc);
+			for(uint32_t lane : lanes) {
+				sum += lane;
+			}
+
+		}
+
+		// Leaving the 256 bit state dirty stalls the legacy SSE instructions of sse2().
+		_mm256_zeroupper();
+
+		return sse2(ptr,length) + sum;
+	}
+
+ #endif // HAVE_CHECKSUM_X86
+
+ #ifdef HAVE_CHECKSUM_NEON
+
+	static uint64_t neon(const uint8_t *ptr, size_t length) noexcept {
+
+		uint64_t sum = 0;
+
+		while(length >= 16) {
+
+			uint32x4_t acc = vdupq_n_u32(0);
+			size_t count = 0;
+
+			// Each step adds at most 2 * 0xFFFF to a lane.
+			while(length >= 16 && count < 0x8000) {
+				acc = vpadalq_u16(acc,vreinterpretq_u16_u8(vld1q_u8(ptr)));
+				ptr += 16;
+				length -= 16;
+				count++;
+			}
+
+			sum += vaddlvq_u32(acc);
+
+		}
+
+		return tail(sum,ptr,length);
+	}
+
+ #endif // HAVE_CHECKSUM_NEON
+
+	struct Engine {
+		const char *name;
+		uint64_t (*sum)(const uint8_t *ptr, size_t length) noexcept;
+	};
+
+	/// @brief The engines built in, the best first.
+	static const Engine engines[] = {
+ #ifdef HAVE_CHECKSUM_X86
+		{ "avx2", avx2 },
+		{ "sse2", sse2 },
+ #endif // HAVE_CHECKSUM_X86
+ #ifdef HAVE_CHECKSUM_NEON
+		{ "neon", neon },
+ #endif // HAVE_CHECKSUM_NEON
+		{ "generic", generic }
+	};
+
+	/// @brief Can the engine run on this CPU?
+	static bool supported(const Engine &engine) noexcept {
+
+ #ifdef HAVE_CHECKSUM_X86
+		__builtin_cpu_init();
+		if(!strcmp(engine.name,"avx2")) {
+			return __builtin_cpu_supports("avx2");
+		}
+		if(!strcmp(engine.name,"sse2")) {
+			return __builtin_cpu_supports("sse2");
+		}
+ #endif // HAVE_CHECKSUM_X86
+
+		return true;
+	}
+
+	static const Engine & select() noexcept {
+
+		static const Engine &engine = []() -> const Engine & {
+			for(const Engine &engine : engines) {
+				if(supported(engine)) {
+					return engine;
+				}
+			}
+			return engines[(sizeof(engines)/sizeof(engines[0]))-1];
+		}();
+
+		return engine;
+	}
+
+	uint16_t Checksum::get(const void *data, size_t length) noexcept {
+
+		if(length < 128) {
+			// Short buffer, the scalar sum is as fast as setting up the vector engines.
+			return ~fold(tail(0,(const uint8_t *) data,length));
+		}
+
+		return ~fold(select().sum((const uint8_t *) data, length));
+	}
+
+	bool Checksum::get(const char *name, const void *data, size_t length, uint16_t &checksum) noexcept {
+
+		for(const Engine &engine : engines) {
+			if(!strcmp(engine.name,name)) {
+				if(!supported(engine)) {
+					return false;
+				}
+				checksum = ~fold(engine.sum((const uint8_t *) data, length));
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint16_t Checksum::update(uint16_t checksum, const void *from, const void *to, size_t length) noexcept {
+
+		// RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m')
+		const uint8_t *before = (const uint8_t *) from;
+		const uint8_t *after = (const uint8_t *) to;
+
+		uint64_t sum = (uint16_t) ~checksum;
+
+		for(size_t ix = 0; ix + 1 < length; ix += 2) {
+
+			uint16_t m, n;
+			memcpy(&m,before+ix,2);
+			memcpy(&n,after+ix,2);
+
+			if(m != n) {
+				sum += (uint16_t) ~m;
+				sum += n;
+			}
+
+		}
+
+		if(length & 1) {
+
+			// Odd byte, padded with zero as the first byte of a word; as get() does.
+			uint16_t m = 0, n = 0;
+			*((uint8_t *) &m) = before[length-1];
+			*((uint8_t *) &n) = after[length-1];
+
+			if(m != n) {
+				sum += (uint16_t) ~m;
+				sum += n;
+			}
+
+		}
+
+		return ~fold(sum);
+	}
+
+	const char * Checksum::engine() noexcept {
+		return select().name;
+	}
+
+ }
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/net/icmp.h>
+ #include <udjat/tools/value.h>
+ #include <stdexcept>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	ICMP::MTU::MTU(uint16_t t, uint16_t f, uint16_t c) : threshold{t}, floor{f}, ceiling{c}, low{f}, high{(uint16_t) (c+1)} {
+		if(ceiling < floor) {
+			throw runtime_error("The largest MTU probe is smaller than the echo request");
+		}
+	}
+
+	uint16_t ICMP::MTU::next() noexcept {
+
+		if(probing) {
+			// Neither answered nor rejected, too large or a blackhole.
+			failed(probing);
+		}
+
+		if(high - low <= 1) {
+
+			// Converged, confirm it and look for a larger MTU now and then.
+			value = low;
+
+			if(++rounds < 64) {
+				probing = low;
+				return probing;
+			}
+
+			rounds = 0;
+			high = ceiling + 1;
+
+		}
+
+		probing = low + ((high - low) / 2);
+		return probing;
+
+	}
+
+	void ICMP::MTU::passed(uint16_t size) noexcept {
+
+		if(size == probing) {
+			probing = 0;
+		}
+
+		if(size > low) {
+			low = size;
+		}
+
+		if(high <= low) {
+			// The path has changed.
+			high = (low < ceiling ? low + 1 : ceiling + 1);
+		}
+
+		if(high - low <= 1) {
+			value = low;
+		}
+
+	}
+
+	void ICMP::MTU::failed(uint16_t size) noexcept {
+
+		probing = 0;
+
+		if(size <= floor) {
+			return;
+		}
+
+		if(size < high) {
+			high = size;
+		}
+
+		if(size <= low) {
+			// The confirmed MTU has stopped working, search again from the bottom.
+			low = floor;
+			rounds = 0;
+		}
+
+	}
+
+	Value & ICMP::MTU::getProperties(Value &value) const {
+
+		value["icmp-mtu"] = (unsigned int) get();
+		if(threshold) {
+			value["icmp-mtu-min"] = (unsigned int) threshold;
+		}
+
+		return value;
+	}
+
+ }
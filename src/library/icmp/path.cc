@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/net/icmp.h>
+ #include <udjat/tools/value.h>
+ #include <stdexcept>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	ICMP::Path::Path(uint8_t length) : hops(length) {
+		if(!length) {
+			throw runtime_error("The path should have at least one hop");
+		}
+	}
+
+	void ICMP::Path::sent() noexcept {
+		lock_guard<mutex> lock(guard);
+		for(Hop &hop : hops) {
+			hop.sent++;
+		}
+	}
+
+	void ICMP::Path::received(uint8_t ttl, const sockaddr_storage &from, uint64_t rtt, bool reached) noexcept {
+
+		if(!ttl || ttl > hops.size()) {
+			return;
+		}
+
+		lock_guard<mutex> lock(guard);
+
+		if(reached && (!distance || ttl < distance)) {
+			distance = ttl;
+		}
+
+		Hop &hop = hops[ttl-1];
+
+		hop.address = from;
+		hop.last = rtt;
+		hop.sum += rtt;
+
+		if(!hop.received || rtt < hop.best) {
+			hop.best = rtt;
+		}
+
+		if(rtt > hop.worst) {
+			hop.worst = rtt;
+		}
+
+		hop.received++;
+
+	}
+
+	std::vector<ICMP::Path::Hop> ICMP::Path::get() const {
+
+		lock_guard<mutex> lock(guard);
+
+		// Beyond the distance every probe is answered by the host itself.
+		size_t length = distance ? distance : hops.size();
+
+		return std::vector<Hop>{hops.begin(),hops.begin()+length};
+
+	}
+
+	Value & ICMP::Path::getProperties(Value &value) const {
+
+		auto seconds = [](uint64_t ns) {
+			return ((double) ns) / ((double) 1000000000);
+		};
+
+		Value &path = value["icmp-path"];
+		path.reset(Value::Array);
+
+		uint8_t ttl = 0;
+		for(const Hop &hop : get()) {
+
+			Value &row = path.append(Value::Object);
+
+			row["ttl"] = (unsigned int) ++ttl;
+			row["ip"] = (hop.received ? std::to_string(hop.address) : string{});
+			row["sent"] = hop.sent;
+			row["received"] = hop.received;
+			row["loss"] = (hop.sent && hop.received < hop.sent) ? ((((float) (hop.sent - hop.received)) * 100) / ((float) hop.sent)) : 0.0F;
+			row["last"] = seconds(hop.last);
+			row["avg"] = seconds(hop.received ? (hop.sum / hop.received) : 0);
+			row["best"] = seconds(hop.best);
+			row["worst"] = seconds(hop.worst);
+
+		}
+
+		return value;
+	}
+
+ }
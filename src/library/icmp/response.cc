@@ -30,7 +30,8 @@
 	"destination-unreachable",
 	"time-exceeded",
 	"timeout",
-	"network-unreachable"
+	"network-unreachable",
+	"mtu-reduced"
  };
 
  using namespace std;
@@ -87,6 +87,14 @@
 			N_("Network is not reachable"),
 			N_("The entire network is unreachable.")
 		},
+		{
+			"mtu-reduced",
+			ICMP::Response::mtu_reduced,
+			Level::warning,
+			N_("Reduced MTU"),
+			N_("${name} path MTU is reduced"),
+			N_("The host is active but large packets are not reaching it, the path MTU is below the expected value.")
+		},
 
 	};
 
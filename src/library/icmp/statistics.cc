@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/net/icmp.h>
+ #include <udjat/tools/value.h>
+ #include <atomic>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	/// @brief Get histogram bucket for RTT.
+	/// @param rtt Round trip time (ns).
+	static size_t bucket(uint64_t rtt) noexcept {
+
+		uint64_t value = rtt / 1000;	// Microseconds.
+
+		if(value < 8) {
+			return (size_t) value;
+		}
+
+		// 8 linear sub-buckets for each power of two.
+		unsigned int octave = 63 - __builtin_clzll(value);
+		size_t index = ((octave - 2) * 8) + ((value >> (octave - 3)) & 0x07);
+
+		return index < ICMP::Statistics::buckets ? index : (ICMP::Statistics::buckets - 1);
+	}
+
+	/// @brief Get the RTT at the middle of a histogram bucket.
+	/// @return Round trip time (ns).
+	static uint64_t value(size_t index) noexcept {
+
+		if(index < 8) {
+			return ((uint64_t) index) * 1000;
+		}
+
+		unsigned int octave = (index / 8) + 2;
+		uint64_t width = ((uint64_t) 1) << (octave - 3);
+		uint64_t lower = (8 + (index % 8)) * width;
+
+		return (lower + (width / 2)) * 1000;
+	}
+
+	ICMP::Statistics::Statistics() noexcept {
+		for(Window &w : windows) {
+			for(auto &h : w.histogram) {
+				h.store(0,memory_order_relaxed);
+			}
+		}
+	}
+
+	void ICMP::Statistics::begin() noexcept {
+		version.store(version.load(memory_order_relaxed)+1,memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
+
+	void ICMP::Statistics::end() noexcept {
+		version.store(version.load(memory_order_relaxed)+1,memory_order_release);
+	}
+
+	uint16_t ICMP::Statistics::sent() noexcept {
+
+		begin();
+
+		uint8_t ix = current.load(memory_order_relaxed);
+		if(windows[ix].sent.load(memory_order_relaxed) >= window) {
+
+			// Current half is full, reuse the oldest one.
+			ix ^= 1;
+
+			Window &w = windows[ix];
+			w.sent.store(0,memory_order_relaxed);
+			w.received.store(0,memory_order_relaxed);
+			w.sum.store(0,memory_order_relaxed);
+			w.min.store(0,memory_order_relaxed);
+			w.max.store(0,memory_order_relaxed);
+			for(auto &h : w.histogram) {
+				h.store(0,memory_order_relaxed);
+			}
+
+			current.store(ix,memory_order_relaxed);
+		}
+
+		windows[ix].sent.fetch_add(1,memory_order_relaxed);
+		count_sent.fetch_add(1,memory_order_relaxed);
+
+		end();
+
+		return ++sequence;
+	}
+
+	void ICMP::Statistics::received(uint16_t seq, uint64_t rtt) noexcept {
+
+		begin();
+
+		// Sequence tracking, 'seen' has bit 'n' set when 'highest - n' was received.
+		if(!seen) {
+			highest = seq;
+			seen = 1;
+		} else {
+
+			int16_t delta = (int16_t) (seq - highest);
+
+			if(delta > 0) {
+
+				seen = (delta >= 64 ? 1 : ((seen << delta) | 1));
+				highest = seq;
+
+			} else {
+
+				unsigned int n = (unsigned int) -delta;
+
+				if(n < 64) {
+					if(seen & (((uint64_t) 1) << n)) {
+						duplicates.fetch_add(1,memory_order_relaxed);
+						end();
+						return;
+					}
+					seen |= (((uint64_t) 1) << n);
+				}
+
+				reordered.fetch_add(1,memory_order_relaxed);
+
+			}
+
+		}
+
+		// RFC 3550 interarrival jitter, applied to the RTT.
+		if(count_received.load(memory_order_relaxed)) {
+			uint64_t previous = last.load(memory_order_relaxed);
+			int64_t j = (int64_t) jitter.load(memory_order_relaxed);
+			int64_t d = (int64_t) (rtt > previous ? rtt - previous : previous - rtt);
+			jitter.store((uint64_t) (j + ((d - j) / 16)),memory_order_relaxed);
+		}
+
+		last.store(rtt,memory_order_relaxed);
+		count_received.fetch_add(1,memory_order_relaxed);
+
+		Window &w = windows[current.load(memory_order_relaxed)];
+
+		if(!w.received.load(memory_order_relaxed) || rtt < w.min.load(memory_order_relaxed)) {
+			w.min.store(rtt,memory_order_relaxed);
+		}
+
+		if(rtt > w.max.load(memory_order_relaxed)) {
+			w.max.store(rtt,memory_order_relaxed);
+		}
+
+		w.received.fetch_add(1,memory_order_relaxed);
+		w.sum.fetch_add(rtt,memory_order_relaxed);
+		w.histogram[bucket(rtt)].fetch_add(1,memory_order_relaxed);
+
+		end();
+
+	}
+
+	void ICMP::Statistics::restore(const Summary &summary) noexcept {
+
+		begin();
+
+		count_sent.store(summary.sent,memory_order_relaxed);
+		count_received.store(summary.received,memory_order_relaxed);
+		duplicates.store(summary.duplicates,memory_order_relaxed);
+		reordered.store(summary.reordered,memory_order_relaxed);
+		jitter.store(summary.jitter,memory_order_relaxed);
+		last.store(summary.last,memory_order_relaxed);
+
+		uint32_t sent = (uint32_t) (summary.sent < window ? summary.sent : window);
+		uint32_t received = (uint32_t) ((((float) sent) * (100.0F - summary.loss) / 100.0F) + 0.5F);
+		if(received > sent) {
+			received = sent;
+		}
+
+		// The older half, the current one is filled first by the new probes.
+		Window &w = windows[current.load(memory_order_relaxed) ^ 1];
+		w.sent.store(sent,memory_order_relaxed);
+		w.received.store(received,memory_order_relaxed);
+		w.sum.store(summary.avg * received,memory_order_relaxed);
+		w.min.store(received ? summary.min : 0,memory_order_relaxed);
+		w.max.store(received ? summary.max : 0,memory_order_relaxed);
+		for(auto &h : w.histogram) {
+			h.store(0,memory_order_relaxed);
+		}
+		if(received) {
+			w.histogram[bucket(summary.avg)].store(received,memory_order_relaxed);
+		}
+
+		end();
+
+	}
+
+	ICMP::Statistics::Summary ICMP::Statistics::get() const noexcept {
+
+		Summary summary;
+		uint32_t histogram[buckets];
+		uint64_t sent, received, sum;
+
+		uint32_t before, after;
+		do {
+
+			before = version.load(memory_order_acquire);
+
+			summary = Summary{};
+			sent = received = sum = 0;
+			memset(histogram,0,sizeof(histogram));
+
+			summary.sent = count_sent.load(memory_order_relaxed);
+			summary.received = count_received.load(memory_order_relaxed);
+			summary.duplicates = duplicates.load(memory_order_relaxed);
+			summary.reordered = reordered.load(memory_order_relaxed);
+			summary.jitter = jitter.load(memory_order_relaxed);
+			summary.last = last.load(memory_order_relaxed);
+
+			for(const Window &w : windows) {
+
+				uint32_t r = w.received.load(memory_order_relaxed);
+
+				if(r) {
+					uint64_t min = w.min.load(memory_order_relaxed);
+					uint64_t max = w.max.load(memory_order_relaxed);
+					if(!received || min < summary.min) {
+						summary.min = min;
+					}
+					if(max > summary.max) {
+						summary.max = max;
+					}
+				}
+
+				sent += w.sent.load(memory_order_relaxed);
+				received += r;
+				sum += w.sum.load(memory_order_relaxed);
+
+				for(size_t ix = 0; ix < buckets; ix++) {
+					histogram[ix] += w.histogram[ix].load(memory_order_relaxed);
+				}
+
+			}
+
+			atomic_thread_fence(memory_order_acquire);
+			after = version.load(memory_order_relaxed);
+
+		} while(before != after || (before & 1));
+
+		if(sent) {
+			summary.loss = (received >= sent ? 0 : (((float) (sent - received)) * 100) / ((float) sent));
+		}
+
+		if(received) {
+
+			summary.avg = sum / received;
+
+			// Percentiles from the merged histogram, clamped to the observed range.
+			struct {
+				double p;
+				uint64_t *value;
+			} percentiles[] = {
+				{ 0.50, &summary.p50 },
+				{ 0.95, &summary.p95 },
+				{ 0.99, &summary.p99 },
+			};
+
+			for(auto &percentile : percentiles) {
+
+				uint64_t target = (uint64_t) ((percentile.p * received) + 0.5);
+				if(!target) {
+					target = 1;
+				}
+
+				uint64_t total = 0;
+				for(size_t ix = 0; ix < buckets; ix++) {
+					total += histogram[ix];
+					if(total >= target) {
+						uint64_t v = value(ix);
+						*percentile.value = (v < summary.min ? summary.min : (v > summary.max ? summary.max : v));
+						break;
+					}
+				}
+
+			}
+
+		}
+
+		return summary;
+
+	}
+
+	Value & ICMP::Statistics::getProperties(Value &value) const {
+
+		Summary summary = get();
+
+		auto seconds = [](uint64_t ns) {
+			return ((double) ns) / ((double) 1000000000);
+		};
+
+		value["icmp-time"] = seconds(summary.last);
+		value["icmp-sent"] = summary.sent;
+		value["icmp-received"] = summary.received;
+		value["icmp-loss"] = summary.loss;
+		value["icmp-duplicates"] = summary.duplicates;
+		value["icmp-reordered"] = summary.reordered;
+		value["icmp-jitter"] = seconds(summary.jitter);
+		value["icmp-rtt-min"] = seconds(summary.min);
+		value["icmp-rtt-avg"] = seconds(summary.avg);
+		value["icmp-rtt-p50"] = seconds(summary.p50);
+		value["icmp-rtt-p95"] = seconds(summary.p95);
+		value["icmp-rtt-p99"] = seconds(summary.p99);
+		value["icmp-rtt-max"] = seconds(summary.max);
+
+		return value;
+	}
+
+ }
+
@@ -22,6 +22,9 @@
  #include <udjat/net/icmp.h>
  #include <udjat/tools/object.h>
  #include <udjat/tools/string.h>
+ #include <udjat/tools/logger.h>
+ #include <cstdlib>
+ #include <cctype>
 
  #ifdef _WIN32
 	#include <private/windows/icmp_controller.h>
@@ -29,6 +32,7 @@
 	#include <linux/capability.h>
 	#include <sys/syscall.h>
 	#include <private/linux/icmp_controller.h>
+	#include <private/linux/tcp_controller.h>
  #endif // _WIN32
 
  #ifdef HAVE_UNISTD_H
@@ -65,14 +69,178 @@
 
 	}
 
-	ICMP::Worker::Worker(time_t timeout, time_t interval) : timers{timeout,interval} {
+	/// @brief Get time attribute, in seconds unless suffixed with 'ms', 's' or 'm'.
+	/// @return Time in milliseconds.
+	static unsigned long getMilliseconds(const pugi::xml_node &node, const char *name, unsigned long def) {
+
+		auto attr = Object::getAttribute(node,name);
+		if(!attr) {
+			return def;
+		}
+
+		const char *str = attr.as_string();
+
+		char *ptr = nullptr;
+		double value = strtod(str,&ptr);
+		while(ptr && isspace(*ptr)) {
+			ptr++;
+		}
+
+		if(!ptr || !*ptr || !strcasecmp(ptr,"s")) {
+			value *= 1000;
+		} else if(!strcasecmp(ptr,"m") || !strcasecmp(ptr,"min")) {
+			value *= 60000;
+		} else if(strcasecmp(ptr,"ms")) {
+			throw runtime_error(Logger::String{"Invalid value '",str,"' on attribute '",name,"'"});
+		}
+
+		if(value < 1) {
+			throw runtime_error(Logger::String{"Attribute '",name,"' should be at least 1ms"});
+		}
+
+		return (unsigned long) value;
+
+	}
+
+	ICMP::Worker::Worker(time_t timeout, time_t interval) : timers{(unsigned long) timeout * 1000,(unsigned long) interval * 1000} {
 		check_capabilities("icmp");
 	}
 
+	ICMP::Worker::Timers::Timers(const pugi::xml_node &node, unsigned long t, unsigned long i)
+		: timeout{getMilliseconds(node,"icmp-timeout",t)}, interval{getMilliseconds(node,"icmp-interval",i)},
+			ceiling{Object::getAttribute(node,"icmp-adaptive").as_bool(false) ? getMilliseconds(node,"icmp-adaptive-max",60000) : 0} {
+
+		if(ceiling && ceiling < interval) {
+			throw runtime_error("Attribute 'icmp-adaptive-max' should not be shorter than 'icmp-interval'");
+		}
+
+	}
+
+	ICMP::Worker::Worker(const Timers &t) : timers{t} {
+	}
+
+	ICMP::Worker::Worker(const Timers &t, Priority p) : timers{t}, priority{p} {
+	}
+
+	static ICMP::Worker::Priority PriorityFactory(const pugi::xml_node &node) {
+
+		auto attr = Object::getAttribute(node,"icmp-priority");
+		if(!attr) {
+			return ICMP::Worker::normal;
+		}
+
+		static const char *names[] = { "high", "normal", "low" };
+		for(size_t ix = 0; ix < N_ELEMENTS(names); ix++) {
+			if(!strcasecmp(attr.as_string(),names[ix])) {
+				return (ICMP::Worker::Priority) ix;
+			}
+		}
+
+		throw runtime_error(Logger::String{"Invalid ICMP priority '",attr.as_string(),"', expecting high, normal or low"});
+
+	}
+
+	static ICMP::Worker::Method MethodFactory(const pugi::xml_node &node) {
+
+		auto attr = Object::getAttribute(node,"probe");
+		if(!attr || !strcasecmp(attr.as_string(),"icmp")) {
+			return ICMP::Worker::icmp_echo;
+		}
+
+#ifndef _WIN32
+		if(!strcasecmp(attr.as_string(),"tcp")) {
+			return ICMP::Worker::tcp_connect;
+		}
+
+		if(!strcasecmp(attr.as_string(),"udp")) {
+			return ICMP::Worker::udp_datagram;
+		}
+#endif // _WIN32
+
+		throw runtime_error(Logger::String{"Invalid probe '",attr.as_string(),"', expecting icmp, tcp or udp"});
+
+	}
+
+	static uint16_t PortFactory(const pugi::xml_node &node, ICMP::Worker::Method method) {
+
+		const char *name;
+		switch(method) {
+		case ICMP::Worker::tcp_connect:
+			name = "tcp-port";
+			break;
+
+		case ICMP::Worker::udp_datagram:
+			name = "udp-port";
+			break;
+
+		default:
+			return 0;
+		}
+
+		unsigned int port = Object::getAttribute(node,name).as_uint(0);
+		if(!port || port > 0xFFFF) {
+			throw runtime_error(Logger::String{"Attribute '",name,"' should be a valid port"});
+		}
+
+		return (uint16_t) port;
+
+	}
+
+	/// @brief Get the length of the echo requests from 'icmp-size', the ICMP data length as in ping -s.
+	static uint16_t LengthFactory(const pugi::xml_node &node) {
+
+		unsigned int size = Object::getAttribute(node,"icmp-size").as_uint(0);
+		if(!size) {
+			return 0;
+		}
+
+		size += ICMP_MINLEN;
+		if(size > (ICMP::Controller::largest - sizeof(struct iphdr))) {
+			throw runtime_error(Logger::String{"Attribute 'icmp-size' should not be above ",(ICMP::Controller::largest - sizeof(struct iphdr) - ICMP_MINLEN)});
+		}
+
+		return (size > sizeof(ICMP::Controller::Packet) ? (uint16_t) size : 0);
+
+	}
+
 	ICMP::Worker::Worker(const pugi::xml_node &node, const char *addr)
-		: Worker(Object::getAttribute(node,"icmp-timeout", (unsigned int) 5),Object::getAttribute(node,"icmp-interval", (unsigned int) 1)) {
+		: timers{node}, priority{PriorityFactory(node)}, method{MethodFactory(node)}, port{PortFactory(node,method)}, length{LengthFactory(node)} {
+
+		if(method == icmp_echo) {
+			check_capabilities(String{node,"name","icmp"}.c_str());
+		}
+
+		{
+			unsigned int hops = Object::getAttribute(node,"icmp-path").as_uint(0);
+			if(hops > 64) {
+				throw runtime_error("Attribute 'icmp-path' should not be above 64 hops");
+			}
+			if(hops && method != icmp_echo) {
+				throw runtime_error("Attribute 'icmp-path' requires ICMP probes");
+			}
+			if(hops) {
+				path.reset(new Path((uint8_t) hops));
+			}
+		}
+
+		if(Object::getAttribute(node,"icmp-pmtu").as_bool(false)) {
 
-		check_capabilities(String{node,"name","icmp"}.c_str());
+			if(method != icmp_echo) {
+				throw runtime_error("Attribute 'icmp-pmtu' requires ICMP probes");
+			}
+
+			unsigned int ceiling = Object::getAttribute(node,"icmp-mtu-max").as_uint(1500);
+			if(ceiling > ICMP::Controller::largest) {
+				throw runtime_error(Logger::String{"Attribute 'icmp-mtu-max' should not be above ",ICMP::Controller::largest});
+			}
+
+			mtu.reset(new MTU(
+				(uint16_t) Object::getAttribute(node,"icmp-mtu-min").as_uint(0),
+				(uint16_t) (sizeof(struct iphdr) + (length ? length : sizeof(ICMP::Controller::Packet))),
+				(uint16_t) ceiling
+			));
+
+		}
 		
 		if(addr && *addr) {
 			IP::Address::set(addr);
@@ -90,11 +258,33 @@
 	}
 
 	void ICMP::Worker::start() {
-		Controller::getInstance().insert(*this);
+
+#ifndef _WIN32
+		if(method == tcp_connect) {
+			TCP::Controller::getInstance().insert(*this);
+			return;
+		}
+#endif // _WIN32
+
+		Controller::getInstance(*this).insert(*this);
 	}
 
 	void ICMP::Worker::stop() {
-		Controller::getInstance().remove(*this);
+
+#ifndef _WIN32
+		{
+			TCP::Controller *tcp = connector.load();
+			if(tcp) {
+				tcp->remove(*this);
+			}
+		}
+#endif // _WIN32
+
+		// The address can change while running, use the shard where the worker was inserted.
+		Controller *shard = controller.load();
+		if(shard) {
+			shard->remove(*this);
+		}
 	}
 
 	bool ICMP::Worker::getProperty(const char *key, std::string &value) const {
@@ -114,10 +304,50 @@
 
 #else
 
-		value["icmp-timeout"] = timers.timeout;
-		value["icmp-interval"] = timers.interval;
-		value["icmp-time"] = ( ((float) time) / ((float)1000000));
-		value["icmp-running"] = busy;
+		{
+			static const char *names[] = { "icmp", "tcp", "udp" };
+			value["probe"] = names[method];
+		}
+
+		if(method == tcp_connect) {
+			value["tcp-port"] = (unsigned int) port;
+		} else if(method == udp_datagram) {
+			value["udp-port"] = (unsigned int) port;
+		}
+
+		value["icmp-timeout"] = ( ((float) timers.timeout) / ((float) 1000));
+		value["icmp-interval"] = ( ((float) timers.interval) / ((float) 1000));
+		{
+			static const char *names[] = { "high", "normal", "low" };
+			value["icmp-priority"] = names[priority];
+		}
+
+		{
+			Controller *shard = controller.load();
+			if(shard) {
+				value["icmp-lag"] = ((float) shard->lag()) / ((float) 1000);
+				value["icmp-deferred"] = shard->deferred();
+			}
+		}
+
+		if(path) {
+			path->getProperties(value);
+		}
+
+		if(mtu) {
+			mtu->getProperties(value);
+		}
+
+		if(length) {
+			value["icmp-size"] = (unsigned int) (length - ICMP_MINLEN);
+		}
+
+		value["icmp-adaptive"] = adaptive();
+		if(adaptive()) {
+			value["icmp-adaptive-max"] = ( ((float) timers.ceiling) / ((float) 1000));
+		}
+		statistics.getProperties(value);
+		value["icmp-running"] = busy.load();
 
 #endif // _WIN32
 
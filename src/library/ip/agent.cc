@@ -25,7 +25,15 @@
  #include <udjat/net/icmp.h>
  #include <udjat/net/dns.h>
  #include <udjat/agent/state.h>
+ #include <udjat/tools/string.h>
+ #include <udjat/tools/logger.h>
  #include <iostream>
+ #include <cstring>
+ #include <ctime>
+
+ #ifndef _WIN32
+	#include <private/linux/snapshot.h>
+ #endif // _WIN32
 
  using namespace std;
 
@@ -35,31 +43,137 @@
 	}
 
 	IP::Agent::Agent(const pugi::xml_node &node, const char *addr) : Abstract::Agent{node}, ICMP::Worker{node,addr} {
+
 		icmp.check = getAttribute(node,"icmp",icmp.check);
+
+#ifndef _WIN32
+		snapshot.path = Snapshot::path(node);
+#endif // _WIN32
+
+		// Dual-stack host, from the 'ipv6' attribute or resolved with the hostname.
+		String ipv6{node,"ipv6",""};
+		if(icmp.check && (!ipv6.empty() || getAttribute(node,"dual-stack",false))) {
+			secondary.reset(new Secondary(*this,node,ipv6.c_str()));
+		}
+
 	}
 
-	void IP::Agent::start() {
+	IP::Agent::~Agent() {
+#ifndef _WIN32
+		if(snapshot.key) {
+			Snapshot::getInstance().remove(*this);
+		}
+#endif // _WIN32
 	}
 
-	void IP::Agent::set(const ICMP::Response response, const IP::Address &) {
+	IP::Agent::Secondary::Secondary(Agent &a, const pugi::xml_node &node, const char *addr) : ICMP::Worker{node,addr}, agent{a} {
+
+		if(!(addr && *addr)) {
+			// The worker takes the 'ip' attribute by default, the address comes from the DNS.
+			IP::Address::clear();
+		} else if(ss_family != AF_INET6) {
+			throw runtime_error(Logger::String{"Attribute 'ipv6' should be an IPv6 address, got '",addr,"'"});
+		}
+
+	}
+
+	IP::Agent::Secondary::~Secondary() {
+		stop();
+	}
 
-		if(response == icmp.response) {
+	void IP::Agent::Secondary::set(const ICMP::Response response, const IP::Address &) {
+		{
+			// The addresses can be probed by different shards.
+			lock_guard<mutex> lock(agent.guard);
+			agent.snapshot.time = 0;
+			agent.icmp.family[1] = response;
+		}
+		agent.update();
+	}
+
+	void IP::Agent::setIPv6(const sockaddr_storage *addr) {
+
+		if(!secondary) {
 			return;
 		}
 
-		// Check for xml defined states.
-		for(auto state : icmp.states) {
-			if(state->id == response) {
-				icmp.state = state;
-				Logger::String{"Setting ICMP state to '",icmp.state->to_string(),"' (",response,")"}.trace(name());
-				updated(true);
+		const sockaddr_storage &current = *secondary;
+		if(addr && addr->ss_family == AF_INET6 && current.ss_family == AF_INET6
+			&& !memcmp(&((const sockaddr_in6 *) &current)->sin6_addr,&((const sockaddr_in6 *) addr)->sin6_addr,sizeof(struct in6_addr))) {
+			return;
+		}
+
+		secondary->stop();
+
+		{
+			lock_guard<mutex> lock(guard);
+			icmp.family[1] = ICMP::invalid;
+		}
+
+		if(addr) {
+			secondary->IP::Address::set(*addr);
+		} else {
+			secondary->IP::Address::clear();
+		}
+
+	}
+
+	void IP::Agent::start() {
+#ifndef _WIN32
+		// Show the state saved before the restart until the first probe.
+		Snapshot::getInstance().insert(*this);
+#endif // _WIN32
+	}
+
+	void IP::Agent::set(const ICMP::Response response, const IP::Address &) {
+		{
+			lock_guard<mutex> lock(guard);
+			snapshot.time = 0;
+			icmp.family[0] = response;
+		}
+		update();
+	}
+
+	void IP::Agent::update() {
+
+		ICMP::Response response;
+		std::shared_ptr<ICMP::State> state;
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			// Dual-stack, a failure of any of the addresses is the state; the IPv4 one first.
+			response = icmp.family[0];
+			if(secondary && (response == ICMP::echo_reply || response == ICMP::invalid) && icmp.family[1] != ICMP::invalid) {
+				if(response == ICMP::invalid || icmp.family[1] != ICMP::echo_reply) {
+					response = icmp.family[1];
+				}
+			}
+
+			if(response == icmp.response && icmp.state) {
 				return;
 			}
+
+			// Check for xml defined states.
+			for(auto &xml : icmp.states) {
+				if(xml->id == response) {
+					state = xml;
+					break;
+				}
+			}
+
+			// Use predefined state.
+			if(!state) {
+				state = ICMP::State::Factory(*this,response);
+			}
+
+			icmp.response = response;
+			icmp.state = state;
+
 		}
 
-		// Use predefined state.
-		icmp.state = ICMP::State::Factory(*this,response);
-		Logger::String{"Setting ICMP state to '",icmp.state->to_string(),"' (",response,")"}.trace(name());
+		// Outside the lock, computeState() takes it.
+		Logger::String{"Setting ICMP state to '",state->to_string(),"' (",response,")"}.trace(name());
 		updated(true);
 
 	}
@@ -97,6 +211,23 @@
 			ICMP::Worker::getProperties(value);
 		}
 
+		if(secondary) {
+			value["ipv6"] = std::to_string((IP::Address) *secondary);
+		}
+
+		// Restored from the snapshot, not probed yet.
+		uint64_t stale;
+		{
+			lock_guard<mutex> lock(guard);
+			stale = snapshot.time;
+		}
+
+		value["stale"] = (stale != 0);
+		if(stale) {
+			uint64_t now = (uint64_t) time(nullptr);
+			value["snapshot-age"] = (unsigned int) (now > stale ? now - stale : 0);
+		}
+
 		return super::getProperties(value);
 	}
 
@@ -126,8 +257,14 @@
 			computed_state = ip.state;
 		}
 
-		if(icmp.state && *icmp.state > *computed_state) {
-			computed_state = icmp.state;
+		std::shared_ptr<ICMP::State> state;
+		{
+			lock_guard<mutex> lock(guard);
+			state = icmp.state;
+		}
+
+		if(state && *state > *computed_state) {
+			computed_state = state;
 		}
 
 		return computed_state;
@@ -145,14 +282,24 @@
 				set(ICMP::invalid,(IP::Address) *this);
 			}
 
-			return false;
+			if(ICMP::Worker::running()) {
+				ICMP::Worker::stop();
+			}
 
-		}
+			// An IPv6 only host, the secondary is probed alone.
+			if(!(secondary && !secondary->IP::Address::empty())) {
+				return false;
+			}
 
-		if(icmp.check && !ICMP::Worker::running()) {
+		} else if(icmp.check && !ICMP::Worker::running()) {
 			ICMP::Worker::start();
 		}
 
+		// Both families on the same cycle.
+		if(secondary && !secondary->IP::Address::empty() && !secondary->running()) {
+			secondary->start();
+		}
+
 		return false;
 	}
 
@@ -23,6 +23,7 @@
 
  #include <udjat/net/gateway.h>
  #include <udjat/net/ip/agent.h>
+ #include <udjat/net/ip/sweep.h>
  #include <udjat/net/dns/agent.h>
 
  using namespace std;
@@ -32,7 +33,7 @@
 	std::shared_ptr<Abstract::Agent> IP::Agent::Factory(const pugi::xml_node &node) {
 
 		
-		switch(String{node,"type","host"}.select("host","default-gateway",nullptr)) {
+		switch(String{node,"type","host"}.select("host","default-gateway","sweep",nullptr)) {
 		case 0:	// IP based host
 			return make_shared<Udjat::IP::Agent>(node);
 			break;
@@ -40,6 +41,9 @@
 		case 1: // Default gateway
 			return make_shared<Udjat::IP::Gateway>(node);
 
+		case 2: // Every address of a subnet
+			return make_shared<Udjat::IP::Sweep>(node);
+
 		default:
 			if(node.attribute("hostname")) {
 				return make_shared<Udjat::DNS::Agent>(node);
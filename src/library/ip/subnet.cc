@@ -23,6 +23,7 @@
  #include <udjat/tools/logger.h>
  #include <udjat/tools/object.h>
  #include <stdexcept>
+ #include <cstring>
 
  using namespace std;
 
@@ -92,8 +93,30 @@
 	}
 
 	/// @brief Test an IPV6 address range.
-	bool IP::SubNet::contains(const sockaddr_in6 &) const {
-		throw std::system_error(ENOTSUP, std::system_category(),"No support for IPV6");
+	bool IP::SubNet::contains(const sockaddr_in6 &addr) const {
+
+		if(this->ss_family != AF_INET6) {
+			return false;
+		}
+
+		const uint8_t *subnet = ((const sockaddr_in6 *) this)->sin6_addr.s6_addr;
+		const uint8_t *value = addr.sin6_addr.s6_addr;
+
+		size_t bits = (this->bits > 128 ? 128 : this->bits);
+
+		// Whole bytes of the prefix, then the remaining bits of the last one.
+		size_t bytes = bits / 8;
+		if(memcmp(subnet,value,bytes)) {
+			return false;
+		}
+
+		if(bits % 8) {
+			uint8_t mask = (uint8_t) (0xFF << (8 - (bits % 8)));
+			return (subnet[bytes] & mask) == (value[bytes] & mask);
+		}
+
+		return true;
+
 	}
 
 	bool IP::SubNet::contains(const sockaddr_storage &addr) const {
@@ -118,6 +141,48 @@
 		return contains((const sockaddr_storage) value);
 	}
 
+	IP::SubNet::Iterator::Iterator(const sockaddr_in &addr) : value{ntohl(addr.sin_addr.s_addr)} {
+	}
+
+	sockaddr_in IP::SubNet::Iterator::operator*() const noexcept {
+		sockaddr_in addr;
+		memset(&addr,0,sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl((uint32_t) value);
+		return addr;
+	}
+
+	/// @brief Get the IPv4 network range.
+	/// @param first The network address (host byte order).
+	/// @return The number of addresses in the subnet.
+	static uint64_t range(const IP::SubNet &subnet, uint64_t &first) {
+
+		if(subnet.ss_family != AF_INET) {
+			throw std::system_error(ENOTSUP, std::system_category(),"Only IPV4 subnets can be enumerated");
+		}
+
+		if(subnet.bits > 32) {
+			throw runtime_error(Logger::String{"Invalid subnet mask /",subnet.bits});
+		}
+
+		uint64_t length = ((uint64_t) 1) << (32 - subnet.bits);
+		first = ntohl(((const sockaddr_in *) &subnet)->sin_addr.s_addr) & ~(length-1) & 0xFFFFFFFF;
+
+		return length;
+	}
+
+	IP::SubNet::Iterator IP::SubNet::begin() const {
+		uint64_t first;
+		uint64_t length = range(*this,first);
+		return Iterator{length > 2 ? first+1 : first};
+	}
+
+	IP::SubNet::Iterator IP::SubNet::end() const {
+		uint64_t first;
+		uint64_t length = range(*this,first);
+		return Iterator{length > 2 ? first+length-1 : first+length};
+	}
+
 	std::string IP::SubNet::to_string() const noexcept {
 
 		if(!ss_family) {
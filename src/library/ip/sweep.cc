@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/net/ip/sweep.h>
+ #include <udjat/tools/logger.h>
+ #include <chrono>
+ #include <stdexcept>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	static uint64_t milliseconds() noexcept {
+		return (uint64_t) chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	IP::Sweep::Probe::Probe(Sweep &s, const ICMP::Worker::Timers &t) : ICMP::Worker{t}, sweep{s} {
+	}
+
+	void IP::Sweep::Probe::set(const ICMP::Response response, const IP::Address &) {
+		sweep.complete(*this,response == ICMP::echo_reply);
+	}
+
+	IP::Sweep::Sweep(const pugi::xml_node &node)
+		: Udjat::Agent<unsigned int>{node}, subnet{node}, rate{getAttribute(node,"rate",100U)}, timers{node,1000,3600000} {
+
+		// The default interval is longer than the timeout, one echo request per address.
+
+		if(subnet.bits < 8) {
+			throw runtime_error("Subnet is too large to sweep, the limit is /8");
+		}
+
+		if(!rate) {
+			throw runtime_error("Attribute 'rate' should be at least 1");
+		}
+
+		first = subnet.begin();
+		length = subnet.size();
+
+		bitmap.alive.resize((length + 63) / 64, 0);
+		bitmap.known.resize((length + 63) / 64, 0);
+
+		// Enough workers to keep the rate until the probes time out.
+		size_t workers = getAttribute(node,"probes",0U);
+		if(!workers) {
+			workers = (size_t) ((((uint64_t) rate) * timers.timeout) / 1000) + 1;
+		}
+
+		if(workers > 4096) {
+			workers = 4096;
+		}
+
+		if(workers > length) {
+			workers = length;
+		}
+
+		for(size_t ix = 0; ix < workers; ix++) {
+			// Not adaptive, a probe must finish to be reused.
+			probes.emplace_back(new Probe(*this,ICMP::Worker::Timers{timers.timeout,timers.interval}));
+			idle.push_back(probes.back().get());
+		}
+
+		Logger::String{
+			"Sweeping ",subnet.to_string()," (",length," addresses) at ",rate," per second with ",workers," probe(s)"
+		}.trace(name());
+
+	}
+
+	IP::Sweep::~Sweep() {
+
+		// Stop the probes while the bitmaps and the idle list are still valid.
+		MainLoop::Timer::disable();
+		for(auto &probe : probes) {
+			probe->stop();
+		}
+
+	}
+
+	void IP::Sweep::start() {
+		super::start();
+		begin();
+	}
+
+	void IP::Sweep::stop() {
+
+		MainLoop::Timer::disable();
+
+		// Without the lock, a probe being notified needs it to finish.
+		for(auto &probe : probes) {
+			probe->stop();
+		}
+
+		{
+			lock_guard<mutex> lock(guard);
+			running = false;
+			idle.clear();
+			for(auto &probe : probes) {
+				idle.push_back(probe.get());
+			}
+		}
+
+		super::stop();
+	}
+
+	bool IP::Sweep::refresh() {
+		begin();
+		return false;
+	}
+
+	void IP::Sweep::begin() {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			if(running) {
+				return;
+			}
+
+			running = true;
+			next = 0;
+			credit = 0;
+			last = milliseconds();
+		}
+
+		MainLoop::Timer::reset(rate >= 100 ? 10 : (1000 / rate));
+		MainLoop::Timer::enable();
+
+	}
+
+	void IP::Sweep::on_timer() {
+
+		vector<Probe *> batch;
+		bool finished = false;
+		unsigned int alive = 0;
+		unsigned int passes = 0;
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			uint64_t now = milliseconds();
+			credit += (now - last) * rate;
+			last = now;
+
+			// Don't burst after a stall, at most one second of probes.
+			if(credit > ((uint64_t) rate) * 1000) {
+				credit = ((uint64_t) rate) * 1000;
+			}
+
+			while(credit >= 1000 && next < length && !idle.empty()) {
+
+				Probe *probe = idle.back();
+				idle.pop_back();
+
+				probe->index = next;
+				probe->IP::Address::set(*(first + next));
+				batch.push_back(probe);
+
+				next++;
+				credit -= 1000;
+
+			}
+
+			if(next >= length && idle.size() == probes.size()) {
+				running = false;
+				count.passes++;
+				finished = true;
+				alive = (unsigned int) count.alive;
+				passes = count.passes;
+			}
+
+		}
+
+		for(Probe *probe : batch) {
+
+			try {
+
+				probe->start();
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant probe ",std::to_string((const sockaddr_storage &) *probe),": ",e.what()}.error(name());
+
+				lock_guard<mutex> lock(guard);
+				idle.push_back(probe);
+
+			}
+
+		}
+
+		if(finished) {
+			MainLoop::Timer::disable();
+			Logger::String{"Sweep ",passes," of ",subnet.to_string()," complete, ",alive," host(s) alive"}.trace(name());
+			set(alive);
+		}
+
+	}
+
+	void IP::Sweep::complete(Probe &probe, bool alive) {
+
+		lock_guard<mutex> lock(guard);
+
+		size_t word = probe.index >> 6;
+		uint64_t mask = ((uint64_t) 1) << (probe.index & 0x3F);
+
+		if(!(bitmap.known[word] & mask)) {
+			bitmap.known[word] |= mask;
+			count.known++;
+		}
+
+		if(alive != ((bitmap.alive[word] & mask) != 0)) {
+			bitmap.alive[word] ^= mask;
+			if(alive) {
+				count.alive++;
+			} else {
+				count.alive--;
+			}
+		}
+
+		idle.push_back(&probe);
+
+	}
+
+	Udjat::Value & IP::Sweep::getProperties(Value &value) const {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			value["subnet"] = subnet.to_string();
+			value["hosts"] = (unsigned int) length;
+			value["alive"] = (unsigned int) count.alive;
+			value["dead"] = (unsigned int) (count.known - count.alive);
+			value["unknown"] = (unsigned int) (length - count.known);
+			value["passes"] = count.passes;
+			value["rate"] = rate;
+		}
+
+		return super::getProperties(value);
+	}
+
+	bool IP::Sweep::getProperties(const char *path, Value &value) const {
+
+		if(super::getProperties(path,value)) {
+			return true;
+		}
+
+		if(!*path) {
+			return false;
+		}
+
+		IP::Address addr;
+		try {
+			addr.set(path);
+		} catch(...) {
+			return false;
+		}
+
+		if(addr.ss_family != AF_INET) {
+			return false;
+		}
+
+		size_t index = IP::SubNet::Iterator{*((const sockaddr_in *) &addr)} - first;
+		if(index >= length) {
+			return false;
+		}
+
+		lock_guard<mutex> lock(guard);
+
+		value["ip"] = std::to_string(addr);
+		value["alive"] = test(bitmap.alive,index);
+		value["probed"] = test(bitmap.known,index);
+
+		return true;
+	}
+
+ }
@@ -32,6 +32,13 @@
  #include <udjat/net/dns.h>
  #include <memory>
 
+ #ifndef _WIN32
+	#include <udjat/net/icmp.h>
+	#include <private/linux/snapshot.h>
+	#include <chrono>
+	#include <cctype>
+ #endif // _WIN32
+
  using namespace std;
 
  namespace Udjat {
@@ -133,10 +140,146 @@
 
 		};
 
+#ifndef _WIN32
+		/// @brief On demand reachability check of a list of addresses.
+		class PingFactory : public Udjat::Action::Factory {
+		public:
+			PingFactory() : Action::Factory("ping") {
+				debug("---> Network::Module::PingFactory()");
+			}
+
+			std::shared_ptr<Action> ActionFactory(const XML::Node &node) const override {
+
+				class Ping : public Action {
+				private:
+					std::vector<IP::Address> addresses;
+					ICMP::Options options;
+
+					/// @brief Count the hosts answering.
+					static size_t reachable(const std::vector<ICMP::Reply> &replies) noexcept {
+						size_t count = 0;
+						for(const ICMP::Reply &reply : replies) {
+							if(reply.response == ICMP::echo_reply || reply.response == ICMP::mtu_reduced) {
+								count++;
+							}
+						}
+						return count;
+					}
+
+				public:
+					Ping(const XML::Node &node) : Action{node} {
+
+						// Addresses separated by commas or spaces.
+						String hosts{node,"hosts",""};
+						const char *ptr = hosts.c_str();
+						while(*ptr) {
+
+							while(*ptr && (isspace(*ptr) || *ptr == ',')) {
+								ptr++;
+							}
+
+							const char *from = ptr;
+							while(*ptr && !isspace(*ptr) && *ptr != ',') {
+								ptr++;
+							}
+
+							if(ptr != from) {
+								addresses.emplace_back();
+								addresses.back().set(std::string{from,(size_t) (ptr-from)}.c_str());
+							}
+
+						}
+
+						if(addresses.empty()) {
+							throw std::runtime_error("Required attribute 'hosts' is missing or empty.");
+						}
+
+						ICMP::Worker::Timers timers{node};
+						options.timeout = timers.timeout;
+						if(node.attribute("icmp-interval")) {
+							options.interval = timers.interval;
+						}
+
+					}
+
+					int call(Udjat::Request &request, Udjat::Response &response, bool except) override {
+
+						try {
+
+							auto future = ICMP::ping(addresses,options);
+
+							// Every probe times out by itself, don't block forever if the controller can't run.
+							unsigned long wait = (options.timeout * 2) + 1000;
+							if(future.wait_for(std::chrono::milliseconds(wait)) != std::future_status::ready) {
+								throw std::runtime_error("Timeout waiting for the ICMP replies");
+							}
+
+							auto replies = future.get();
+
+							Value &hosts = response["hosts"];
+							hosts.reset(Value::Array);
+
+							for(const ICMP::Reply &reply : replies) {
+								Value &row = hosts.append(Value::Object);
+								row["ip"] = std::to_string(reply.address);
+								row["response"] = std::to_string(reply.response);
+								row["from"] = ((reply.response == ICMP::timeout || reply.response == ICMP::invalid) ? string{} : std::to_string(reply.from));
+								row["rtt"] = ((double) reply.rtt) / ((double) 1000000000);
+							}
+
+							response["reachable"] = (unsigned int) reachable(replies);
+
+						} catch(const std::exception &e) {
+
+							response.failed(e);
+
+							if(except) {
+								throw;
+							}
+
+							return -1;
+
+						}
+
+						return 0;
+					}
+
+					bool activate() noexcept override {
+
+						try {
+
+							Logger::String{"Probing ",addresses.size()," host(s)"}.trace();
+
+							ICMP::ping(addresses,[](std::vector<ICMP::Reply> &replies){
+								Logger::String{reachable(replies)," of ",replies.size()," host(s) answered"}.info();
+							},options);
+
+						} catch(const std::exception &e) {
+
+							Logger::String{"Cant probe hosts: ",e.what()}.error();
+							return false;
+
+						}
+
+						return true;
+					}
+
+				};
+
+				return make_shared<Ping>(node);
+
+			}
+
+		};
+#endif // _WIN32
+
 		class Module : public Udjat::Module {
 		private:
 			HostFactory hFactory;
 			NicFactory nFactory;
+#ifndef _WIN32
+			PingFactory pFactory;
+#endif // _WIN32
 
 		public:
 
@@ -145,6 +288,10 @@
 			};
 
 			~Module() override {
+#ifndef _WIN32
+				// Deinit, save the agents now; not from the static destructor of the snapshot.
+				IP::Snapshot::getInstance().stop();
+#endif // _WIN32
 			};
 
 		};
@@ -157,6 +304,9 @@
 	}
 
 	Network::Module::~Module() {
+#ifndef _WIN32
+		IP::Snapshot::getInstance().stop();
+#endif // _WIN32
 	}
 
 
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/linux/delivery.h>
+ #include <udjat/tools/logger.h>
+ #include <algorithm>
+
+ namespace Udjat {
+
+	/// @brief Delivery running on this thread, nullptr if none.
+	static thread_local const ICMP::Delivery *delivering = nullptr;
+
+	ICMP::Delivery::Delivery(mutex &g, const char *n, const std::function<bool(const ICMP::Worker &worker)> &o)
+		: guard{g}, name{n}, owns{o} {
+	}
+
+	void ICMP::Delivery::drop(const ICMP::Worker &worker) noexcept {
+
+		results.erase(
+			std::remove_if(results.begin(),results.end(),[&worker](const Result &result){
+				return result.worker == &worker;
+			}),
+			results.end()
+		);
+
+		// Results being delivered, the worker can be gone before deliver() reaches them.
+		for(Result &result : delivered) {
+			if(result.worker == &worker) {
+				result.worker = nullptr;
+			}
+		}
+
+	}
+
+	void ICMP::Delivery::wait(const ICMP::Worker &worker) {
+
+		// The worker can be notifying itself (stop() called from set()), otherwise
+		// wait for a notification running on another thread.
+		if(delivering != this) {
+			unique_lock<mutex> lock(waiting);
+			notified.wait(lock,[this,&worker]() {
+				return notifying.load() != &worker;
+			});
+		}
+
+	}
+
+	void ICMP::Delivery::deliver() {
+
+		lock_guard<mutex> serialize(delivery);
+
+		{
+			lock_guard<mutex> lock(guard);
+			if(results.empty()) {
+				return;
+			}
+			delivered.swap(results);
+		}
+
+		delivering = this;
+
+		for(const Result &result : delivered) {
+
+			ICMP::Worker *worker;
+
+			{
+				// drop() clears the results of the worker under the lock, then wait() waits for
+				// 'notifying'; either the result is gone or wait() sees the worker here.
+				lock_guard<mutex> lock(guard);
+				worker = result.worker;
+				if(worker && !owns(*worker)) {
+					worker = nullptr;
+				}
+				notifying = worker;
+			}
+
+			if(worker) {
+
+				try {
+
+					worker->set(result.response,result.from);
+
+				} catch(const std::exception &e) {
+
+					Logger::String{"Error notifying ",std::to_string((const sockaddr_storage &) *worker),": ",e.what()}.error(name);
+
+				}
+
+			}
+
+			{
+				lock_guard<mutex> lock(waiting);
+				notifying = nullptr;
+			}
+			notified.notify_all();
+
+		}
+
+		delivering = nullptr;
+
+		{
+			lock_guard<mutex> lock(guard);
+			delivered.clear();
+		}
+
+	}
+
+ }
@@ -19,6 +19,11 @@
 
  #include <config.h>
  #include <private/linux/icmp_controller.h>
+ #include <private/checksum.h>
+
+ #ifdef HAVE_LIBURING
+	#include <private/linux/icmp_uring.h>
+ #endif // HAVE_LIBURING
 
  #include <unistd.h>
  #include <netdb.h>
@@ -29,298 +34,1487 @@
  #include <udjat/tools/threadpool.h>
  #include <udjat/tools/logger.h>
  #include <udjat/tools/handler.h>
+ #include <udjat/tools/configuration.h>
  #include <udjat/net/icmp.h>
  #include <udjat/net/ip/address.h>
  #include <netinet/ip_icmp.h>
+ #include <linux/filter.h>
+ #include <linux/net_tstamp.h>
+ #include <linux/errqueue.h>
+ #include <memory>
+ #include <thread>
+ #include <algorithm>
 
  namespace Udjat {
 
-	#pragma pack(1)
-	struct Packet {
-		struct icmp icmp;
-		struct ICMP::Controller::Payload payload;
-	};
-	#pragma pack()
+	/// @brief FNV-1a hash of the IP address.
+	static uint32_t hash(const sockaddr_storage &addr) noexcept {
+
+		const uint8_t *ptr;
+		size_t length;
+
+		switch(addr.ss_family) {
+		case AF_INET:
+			ptr = (const uint8_t *) &((const sockaddr_in *) &addr)->sin_addr;
+			length = sizeof(in_addr);
+			break;
+
+		case AF_INET6:
+			ptr = (const uint8_t *) &((const sockaddr_in6 *) &addr)->sin6_addr;
+			length = sizeof(in6_addr);
+			break;
+
+		default:
+			return 0;
+		}
+
+		uint32_t value = 2166136261U;
+		while(length--) {
+			value ^= *(ptr++);
+			value *= 16777619U;
+		}
+
+		return value;
+	}
+
+	unsigned int ICMP::Controller::shards = 0;
+
+	/// @brief Padding of the larger probes, shared by every message.
+	static const uint8_t padding[ICMP::Controller::largest] = { 0 };
+
+	ICMP::Controller & ICMP::Controller::getInstance(const sockaddr_storage &addr) {
+
+		static vector<unique_ptr<Controller>> instances = []() {
+
+			unsigned int count = (shards ? shards : Config::Value<unsigned int>("network","icmp-shards",1));
+			if(!count) {
+				count = thread::hardware_concurrency();
+			}
+
+			if(!count) {
+				count = 1;
+			} else if(count > 64) {
+				count = 64;
+			}
+
+			if(count > 1) {
+				Logger::String{"Using ",count," ICMP controller shards"}.write(Logger::Trace,"ICMP");
+			}
+
+			// Egress budget, shared by the shards.
+			unsigned int rate = Config::Value<unsigned int>("network","icmp-rate",0);
+			unsigned int burst = Config::Value<unsigned int>("network","icmp-burst",rate / 10);
+
+			if(rate) {
+				Logger::String{"ICMP egress budget is ",rate," probes per second, burst of ",burst}.write(Logger::Trace,"ICMP");
+			}
+
+			vector<unique_ptr<Controller>> instances;
+			for(unsigned int ix = 0; ix < count; ix++) {
+				instances.emplace_back(new Controller(ix,count > 1));
+				if(rate) {
+					instances.back()->budget.setup(
+						max(rate / count, 1U),
+						max(burst / count, 1U)
+					);
+				}
+			}
+			return instances;
+
+		}();
+
+		if(instances.size() == 1) {
+			return *instances[0];
+		}
+
+		return *instances[hash(addr) % instances.size()];
 
-	ICMP::Controller::Controller() : MainLoop::Handler(-1, MainLoop::Handler::oninput) {
+	}
+
+	ICMP::Controller::Controller(unsigned int i, bool t)
+		: MainLoop::Handler(-1, MainLoop::Handler::oninput), index{i}, ident{(uint16_t) (getpid() + i)}, threaded{t} {
+		tokens = (uint32_t) (getCurrentTime() / 1000);
+		memset(&output.model,0,sizeof(output.model));
+		output.model.icmp.icmp_type = ICMP_ECHO;
+		output.model.icmp.icmp_id = htons(ident);
+		output.model.icmp.icmp_cksum = Checksum::get(&output.model,sizeof(output.model));
 	}
 
 	ICMP::Controller::~Controller() {
-		lock_guard<recursive_mutex> lock(guard);
+
+		lock_guard<mutex> lock(guard);
 	 	stop();
+
+		Command *command = commands.exchange(nullptr);
+		while(command) {
+			Command *next = command->next;
+			delete command;
+			command = next;
+		}
+
+	}
+
+	static inline uint64_t nanoseconds(const struct timespec &tm) noexcept {
+		return (((uint64_t) tm.tv_sec) * 1000000000ULL) + ((uint64_t) tm.tv_nsec);
 	}
 
 	uint64_t ICMP::Controller::getCurrentTime() noexcept {
 
-			struct timespec tm;
-			clock_gettime(CLOCK_MONOTONIC_RAW, &tm);
+		struct timespec tm;
+		clock_gettime(CLOCK_MONOTONIC, &tm);
+
+		return nanoseconds(tm);
+
+	}
+
+	uint64_t ICMP::Controller::getCurrentTime(const struct timespec &timestamp) noexcept {
+
+		struct timespec realtime, monotonic;
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		clock_gettime(CLOCK_MONOTONIC, &monotonic);
+
+		uint64_t stamp = nanoseconds(timestamp);
+		uint64_t now = nanoseconds(realtime);
+		uint64_t current = nanoseconds(monotonic);
+
+		if(stamp > now || (now - stamp) > current) {
+			// The wall clock went back, the timestamp can't be compared with the monotonic clock.
+			return 0;
+		}
+
+		return current - (now - stamp);
+
+	}
+
+	/// @brief Get kernel software timestamp from message.
+	/// @return Timestamp in nanoseconds on the getCurrentTime() clock, zero if not available.
+	static uint64_t timestamp(const struct msghdr &msg) noexcept {
+
+		for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *) &msg,cmsg)) {
+			if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+				const struct scm_timestamping *ts = (const struct scm_timestamping *) CMSG_DATA(cmsg);
+				return ICMP::Controller::getCurrentTime(ts->ts[0]);
+			}
+		}
+
+		return 0;
+	}
+
+	/// @brief Do the socket addresses have the same IP?
+	static bool same(const sockaddr_storage &a, const sockaddr_storage &b) noexcept {
+
+		if(a.ss_family != b.ss_family) {
+			return false;
+		}
+
+		switch(a.ss_family) {
+		case AF_INET:
+			return ((const sockaddr_in *) &a)->sin_addr.s_addr == ((const sockaddr_in *) &b)->sin_addr.s_addr;
+
+		case AF_INET6:
+			return !memcmp(&((const sockaddr_in6 *) &a)->sin6_addr,&((const sockaddr_in6 *) &b)->sin6_addr,sizeof(in6_addr));
+
+		}
+
+		return false;
+	}
+
+	uint64_t ICMP::Controller::getMilliseconds() noexcept {
 
-			uint64_t time = tm.tv_sec;
-			time *= 1000000;
-			time += tm.tv_nsec;
+		struct timespec tm;
+		clock_gettime(CLOCK_MONOTONIC, &tm);
+
+		return (((uint64_t) tm.tv_sec) * 1000) + (tm.tv_nsec / 1000000);
 
-			return time;
 	}
 
 	void ICMP::Controller::stop() {
 
+#ifdef HAVE_LIBURING
+		if(ring) {
+			ring->detach();
+		}
+		uring = false;
+#endif // HAVE_LIBURING
+
 		this->Handler::disable();
 		this->Timer::disable();
 		this->Handler::close();
+		listening = false;
+		dontfragment = false;
+		output.clear();
+		udp.stop();
+		icmp6.stop();
+		wakeup = 0;
+
+		if(!active) {
+			// Table is empty, restart ids from zero.
+			hosts.clear();
+			available.clear();
+			streams.clear();
+			services.clear();
+			deadlines = decltype(deadlines)();
+		}
 
 		Logger::String{"Listener disabled"}.write(Logger::Debug,"ICMP");
 
 	}
 
-	void ICMP::Controller::handle_event(const Event event) {
+	ICMP::Controller::Input::Input() noexcept {
+		memset(msgs,0,sizeof(msgs));
+		for(size_t ix = 0; ix < length; ix++) {
+			iov[ix].iov_base = buffer[ix];
+			iov[ix].iov_len = size;
+			msgs[ix].msg_hdr.msg_iov = &iov[ix];
+			msgs[ix].msg_hdr.msg_iovlen = 1;
+			msgs[ix].msg_hdr.msg_name = &addr[ix];
+			msgs[ix].msg_hdr.msg_control = control[ix];
+		}
+		reset();
+	}
 
-		lock_guard<recursive_mutex> lock(guard);
+	void ICMP::Controller::Input::reset() noexcept {
+		for(size_t ix = 0; ix < length; ix++) {
+			msgs[ix].msg_hdr.msg_namelen = sizeof(addr[ix]);
+			msgs[ix].msg_hdr.msg_controllen = sizeof(control[ix]);
+			msgs[ix].msg_hdr.msg_flags = 0;
+			msgs[ix].msg_len = 0;
+		}
+	}
 
-		if(event & MainLoop::Handler::oninput) {
+	void ICMP::Controller::handle_event(const Event event) {
 
-			// Receive packet.
-			#pragma pack(1)
-			struct {
-				struct iphdr    hdr;
-				struct Packet   packet;
-			} in;
-			#pragma pack()
+		if(threaded) {
 
-			struct sockaddr_storage addr;
-			socklen_t szAddr = sizeof(addr);
+			// Keep the main loop off this socket until the queued work has drained it.
+			this->Handler::disable();
 
-			memset(&in,0,sizeof(in));
-			memset(&addr,0,sizeof(addr));
+			ThreadPool::getInstance().push([this,event]() {
+				{
+					lock_guard<mutex> lock(guard);
+					read(event);
+					if(Handler::values.fd >= 0) {
+						this->Handler::enable();
+					}
+				}
+				deliver();
+			});
 
-			int rc = recvfrom(fd(),&in,sizeof(in),MSG_DONTWAIT,(struct sockaddr *) &addr,&szAddr);
-			if(rc < 0) {
-				cerr << "ICMP\tError '" << strerror(errno) << "' receiving ICMP packet" << endl;
-				return;
-			}
+			return;
+		}
 
-			if(rc != sizeof(in)) {
-				if(Logger::enabled(Logger::Trace)) {
-					Logger::String{
-						"Ignoring packet with invalid size, got ",
-						rc,
-						" expecting ",
-						sizeof(in)
-					}.write(Logger::Trace,"ICMP");
-				}
-				return;
-			}
+		{
+			lock_guard<mutex> lock(guard);
+			read(event);
+		}
+		deliver();
 
-			if(htons(in.packet.icmp.icmp_id) != (uint16_t) getpid()) {
-				Logger::String{
-					"Ignoring packet with invalid id, got ",
-					htons(in.packet.icmp.icmp_id),
-					" expecting ",
-					((uint16_t) getpid())
-				}.write(Logger::Trace,"ICMP");
-				return;
-			}
+	}
 
-			Logger::String("Response ",htons(in.packet.icmp.icmp_seq)," from ",std::to_string(addr)).trace("icmp");
+	void ICMP::Controller::read(const Event event) {
 
-			hosts.remove_if([&in,&addr](Host &host) {
-				if(host.onResponse(in.packet.icmp.icmp_type,addr,in.packet.payload)) {
-					host.worker.busy = false;
-					return true;
-				}
-				return false;
-			});
+		// Transmit timestamps are queued on the error queue, read them before the replies.
+		drain(MSG_ERRQUEUE);
 
+		if(!(event & MainLoop::Handler::oninput)) {
+			return;
 		}
 
+		// Drain the socket, dispatching the whole batch under the same lock.
+		size_t count = drain(0);
+
+		uint64_t wakeups = received.update(count);
+
+		if(Logger::enabled(Logger::Trace)) {
+			Logger::String{"Got ",count," packet(s) on wakeup ",wakeups," of shard ",index}.write(Logger::Trace,"ICMP");
+		}
 
 	}
 
-	void ICMP::Controller::on_timer() {
+	size_t ICMP::Controller::drain(const MainLoop::Handler &socket, int flags) {
 
-		ThreadPool::getInstance().push([this]() {
+		size_t count = 0;
+		while(socket.fd() >= 0) {
+
+			input.reset();
 
-			lock_guard<recursive_mutex> lock(guard);
+			int rc = recvmmsg(socket.fd(),input.msgs,Input::length,MSG_DONTWAIT|flags,NULL);
+			if(rc < 0) {
+				if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					cerr << "ICMP\tError '" << strerror(errno) << "' receiving ICMP packets" << endl;
+				}
+				break;
+			}
+
+			for(int ix = 0; ix < rc; ix++) {
 
-			// Send packets.
-			hosts.remove_if([](Host &host) {
-				if(!host.onTimer()) {
-					host.worker.busy = false;
-					return true;
+				const struct msghdr &msg = input.msgs[ix].msg_hdr;
+
+				if(flags & MSG_ERRQUEUE) {
+					error(msg,input.buffer[ix],input.msgs[ix].msg_len);
+					continue;
 				}
-				return false;
-			});
 
-			if(hosts.empty()) {
-				Logger::String{"No more hosts, disabling listener"}.write(Logger::Trace,"ICMP");
-				stop();
+				// Prefer the kernel receive time, it doesn't include the main loop latency.
+				uint64_t time = timestamp(msg);
+				receive(input.buffer[ix],input.msgs[ix].msg_len,input.addr[ix],time ? time : getCurrentTime());
+
 			}
 
-		});
+			count += rc;
+
+			if(((size_t) rc) < Input::length) {
+				break;
+			}
+
+		}
+
+		return count;
 
 	}
 
-	void ICMP::Controller::start() {
+	void ICMP::Controller::error(const struct msghdr &msg, const uint8_t *data, size_t length) {
 
-		try {
+		for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *) &msg,cmsg)) {
 
-			Logger::String{"Starting Listener"}.write(Logger::Trace,"ICMP");
+			if(!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+				continue;
+			}
 
-			// Create socket
-			if(Handler::values.fd <= 0) {
+			const struct sock_extended_err *err = (const struct sock_extended_err *) CMSG_DATA(cmsg);
 
-				// Reference: https://github.com/schweikert/fping/blob/develop/src/socket4.c
-				protoent * proto = getprotobyname("icmp");
-				if(!proto) {
-					throw runtime_error("ICMP: Unknown protocol");
-				}
+			if(err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && length >= sizeof(Payload)) {
+
+				// Looped packet, the payload is at the end of it whatever the headers are; padded
+				// probes don't match a host and keep the user space send time.
+				Payload payload;
+				memcpy(&payload,data+(length-sizeof(Payload)),sizeof(Payload));
 
-				Handler::values.fd = socket(AF_INET, SOCK_RAW, proto->p_proto);
-				if(Handler::values.fd < 0) {
-					throw std::system_error(errno, std::system_category(), "Cant create ICMP socket");
+				Host *host = find(payload);
+				if(host && host->packets == payload.seq && !payload.ttl) {
+					host->sent = timestamp(msg);
 				}
 
-				// Set non-blocking
-				int flags;
+			} else if((err->ee_origin == SO_EE_ORIGIN_ICMP || err->ee_origin == SO_EE_ORIGIN_ICMP6) && length >= ICMP_MINLEN) {
 
-				if ((flags = fcntl(Handler::values.fd, F_GETFL, 0)) < 0) {
-					throw std::system_error(errno, std::system_category(), "Cant get ICMP socket flags");
-				}
+				// Datagram sockets, the data is the echo request embedded in the message;
+				// ee_info is the next hop MTU of fragmentation needed errors.
+				uint8_t type = err->ee_type;
+				uint8_t code = err->ee_code;
+				size_t header = offsetof(Packet,payload);
 
-				if (fcntl(Handler::values.fd, F_SETFL, flags | O_NONBLOCK) < 0){
-					throw std::system_error(errno, std::system_category(), "Cant set ICMP socket flags");
+				if(err->ee_origin == SO_EE_ORIGIN_ICMP6) {
+					if(!translate(type,code)) {
+						continue;
+					}
+					header = sizeof(struct icmp6_hdr);
 				}
 
+				sockaddr_storage from;
+				memset(&from,0,sizeof(from));
+				memcpy(&from,SO_EE_OFFENDER(err),(err->ee_origin == SO_EE_ORIGIN_ICMP6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in)));
+
+				uint64_t time = timestamp(msg);
+				original(
+					type,
+					code,
+					(uint16_t) std::min(err->ee_info,(uint32_t) UINT16_MAX),
+					ntohs(((const struct icmp *) data)->icmp_seq),
+					data+header,
+					(length > header ? length - header : 0),
+					from,
+					time ? time : getCurrentTime()
+				);
+
 			}
 
-			// Timer for packet sent.
-			this->Timer::reset(1000L);
-			if(!this->Timer::enabled()) {
-				this->Timer::enable();
+		}
+
+	}
+
+	void ICMP::Controller::receive(const uint8_t *data, size_t length, const sockaddr_storage &addr, uint64_t time) {
+
+		if(addr.ss_family == AF_INET6) {
+			receive6(data,length,addr,time);
+			return;
+		}
+
+		// Datagram sockets deliver the ICMP message without the IP header.
+		size_t offset = 0;
+		if(!datagram) {
+			if(length < sizeof(struct iphdr)) {
+				return;
 			}
+			offset = ((size_t) (data[0] & 0x0f)) * 4;
+		}
 
-			if(!this->Handler::enabled()) {
-				Logger::String{"Enabling listener"}.write(Logger::Debug,"ICMP");
-				this->Handler::enable();
+		if(length >= (offset + ICMP_MINLEN)) {
+
+			const struct icmp *header = (const struct icmp *) (data+offset);
+			if(header->icmp_type == ICMP_TIME_EXCEEDED || header->icmp_type == ICMP_DEST_UNREACH) {
+				embedded(*header,data+offset+ICMP_MINLEN,length-(offset+ICMP_MINLEN),addr,time);
+				return;
 			}
 
-		} catch(...) {
+		}
 
-			stop();
-			throw;
+		// Padded replies are truncated to the receive buffer, the payload is at the start.
+		if(length < (offset + sizeof(Packet))) {
+			if(Logger::enabled(Logger::Trace)) {
+				Logger::String{
+					"Ignoring packet with invalid size, got ",
+					length,
+					" expecting at least ",
+					(offset + sizeof(Packet))
+				}.write(Logger::Trace,"ICMP");
+			}
+			return;
+		}
 
+		const Packet *packet = (const Packet *) (data+offset);
+
+		// The kernel already matched the socket id on datagram sockets.
+		if(!datagram && htons(packet->icmp.icmp_id) != ident) {
+			if(Logger::enabled(Logger::Trace)) {
+				Logger::String{
+					"Ignoring packet with invalid id, got ",
+					htons(packet->icmp.icmp_id),
+					" expecting ",
+					ident
+				}.write(Logger::Trace,"ICMP");
+			}
+			return;
 		}
 
+		Host *host = find(packet->payload);
+		if(host) {
+			response(*host,packet->icmp.icmp_type,addr,packet->payload,time);
+		}
 
 	}
 
-	void ICMP::Controller::insert(ICMP::Worker &worker) {
+	void ICMP::Controller::response(Host &host, int type, const sockaddr_storage &addr, const Payload &payload, uint64_t time) {
 
-		lock_guard<recursive_mutex> lock(guard);
+		if(host.onResponse(type,addr,payload,time)) {
+			release(host);
+		} else if(host.scheduled != host.deadline()) {
+			// Adaptive host, the next probe was moved.
+			schedule(host);
+			if(!wakeup || host.scheduled < wakeup) {
+				arm(getMilliseconds());
+			}
+		}
 
-		if(worker.busy) {
-			throw std::system_error(EBUSY, std::system_category(), "ICMP Listener is already active");
+	}
+
+	void ICMP::Controller::embedded(const struct icmp &header, const uint8_t *data, size_t length, const sockaddr_storage &from, uint64_t time) {
+
+		if(length < sizeof(struct iphdr)) {
+			return;
+		}
+
+		size_t offset = ((size_t) (data[0] & 0x0f)) * 4;
+		if(offset < sizeof(struct iphdr) || length < (offset + ICMP_MINLEN)) {
+			return;
 		}
 
-		start();
-		worker.busy = true;
-		hosts.emplace_back(worker);
+		const struct icmp *icmp = (const struct icmp *) (data+offset);
+		if(icmp->icmp_type != ICMP_ECHO || (!datagram && ntohs(icmp->icmp_id) != ident)) {
+			return;
+		}
+
+		original(
+			header.icmp_type,
+			header.icmp_code,
+			ntohs(header.icmp_nextmtu),
+			ntohs(icmp->icmp_seq),
+			data+offset+offsetof(Packet,payload),
+			(length > (offset + offsetof(Packet,payload)) ? length - (offset + offsetof(Packet,payload)) : 0),
+			from,
+			time
+		);
 
 	}
 
-	void ICMP::Controller::remove(ICMP::Worker &worker) {
+	void ICMP::Controller::original(uint8_t type, uint8_t code, uint16_t mtu, uint16_t seq, const uint8_t *data, size_t length, const sockaddr_storage &from, uint64_t time) {
+
+		if(type != ICMP_TIME_EXCEEDED && type != ICMP_DEST_UNREACH) {
+			return;
+		}
 
-		lock_guard<recursive_mutex> lock(guard);
+		// Routers quote at least the ICMP header, Linux and RFC 1812 routers the whole
+		// request; with the payload the error goes to the host without waiting the timeout.
+		if(length >= sizeof(Payload)) {
 
-		hosts.remove_if([&worker](Host &h) {
-			if(&h.worker == &worker) {
-				worker.busy = false;
-				return true;
+			Payload payload;
+			memcpy(&payload,data,sizeof(payload));
+
+			if(!payload.ttl && !payload.mtu) {
+				Host *host = find(payload);
+				if(host && !(type == ICMP_DEST_UNREACH && code == ICMP_FRAG_NEEDED)) {
+					response(*host,type,from,payload,time);
+				}
+				return;
 			}
-			return false;
-		});
 
-		if(hosts.empty()) {
-			stop();
+		}
+
+		// Path probes, identified by the sequence on the wire.
+		if(type == ICMP_TIME_EXCEEDED) {
+			hop(seq,from,time);
+		} else if(code == ICMP_FRAG_NEEDED) {
+			fragment(seq,mtu);
 		}
 
 	}
 
-	static unsigned short in_chksum(const unsigned short *buf, int sz) {
+	void ICMP::Controller::fragment(uint16_t seq, uint16_t mtu) {
 
-		int nleft = sz;
-		int sum = 0;
-		const unsigned short *w = buf;
-		unsigned short ans = 0;
+		if(traces.empty()) {
+			return;
+		}
 
-		while (nleft > 1) {
-			sum += *w++;
-			nleft -= 2;
+		Trace &trace = traces[seq];
+		if(!trace.mtu) {
+			return;
 		}
 
-		if (nleft == 1) {
-			*(unsigned char *) (&ans) = *(unsigned char *) w;
-			sum += ans;
+		Host *host = find(trace.id);
+		if(host && host->token == trace.token && host->worker->mtu) {
+			// The next hop can't take it, nothing larger than its MTU passes either.
+			host->worker->mtu->failed((mtu && mtu < trace.mtu) ? (mtu + 1) : trace.mtu);
 		}
 
-		sum = (sum >> 16) + (sum & 0xFFFF);
-		sum += (sum >> 16);
-		ans = ~sum;
-		return ans;
+		trace.mtu = 0;
+
 	}
 
-	void ICMP::Controller::send(const sockaddr_storage &addr, const Payload &payload) {
+	void ICMP::Controller::hop(uint16_t seq, const sockaddr_storage &from, uint64_t time) {
 
-		if(Handler::values.fd < 0) {
-			throw runtime_error("ICMP Controller is not available");
+		if(traces.empty()) {
+			return;
 		}
 
-		switch(addr.ss_family) {
-		case AF_INET:
-			{
-				Logger::String(
-					"Sending ICMP ", payload.id ,".", payload.seq, " to ", std::to_string(addr)
-#ifdef DEBUG
-					, " on socket ", Handler::values.fd
-#endif // DEBUG
-				).write(Logger::Debug,"ICMP");
+		Trace &trace = traces[seq];
+		if(!trace.ttl) {
+			return;
+		}
+
+		Host *host = find(trace.id);
+		if(host && host->token == trace.token && host->worker->path && time > trace.time) {
+			host->worker->path->received(trace.ttl,from,time - trace.time,false);
+		}
 
-				// Send package
-				Packet packet;
+		trace.ttl = 0;
 
-				memset(&packet,0,sizeof(packet));
-				packet.payload = payload;
+	}
+
+	void ICMP::Controller::on_timer() {
+
+		// Disarm until the queued work reschedules it.
+		this->Timer::disable();
+
+		ThreadPool::getInstance().push([this]() {
 
-				static uint16_t seq = 0;
-				packet.icmp.icmp_type = ICMP_ECHO;
-				packet.icmp.icmp_seq = htons(++seq);
-				packet.icmp.icmp_id = htons(getpid());
-				packet.icmp.icmp_cksum = in_chksum((unsigned short *) &packet, sizeof(packet));
+			{
+				lock_guard<mutex> lock(guard);
 
-				if(sendto(Handler::values.fd, (char *) &packet, sizeof(packet), 0, (const sockaddr *) &addr, sizeof(addr)) != sizeof(packet)) {
+				// Workers queued since the last job enter the table before the scan.
+				execute();
 
-					int code = errno;
+				wakeup = 0;
+				uint64_t now = getMilliseconds();
 
-					hosts.remove_if([code,&packet](Host &host) {
-						if(host.onError(code,packet.payload)) {
-							host.worker.busy = false;
-							return true;
-						}
-						return false;
-					});
+				dispatch(now);
+				flush();
 
+				if(active) {
+					arm(now);
+				} else {
+					Logger::String{"No more hosts, disabling listener"}.write(Logger::Trace,"ICMP");
+					stop();
 				}
 			}
-			break;
 
-		case AF_INET6:
-			// TODO: Add IPV6 support.
-			throw std::system_error(ENOTSUP, std::system_category(), "Unable to send IPV6 ICMP request");
-			break;
+			// Timeouts are reported after the lock is released.
+			deliver();
 
-		default:
-			throw runtime_error(string{"Unsupported family: "} + std::to_string((int) addr.ss_family));
+		});
+
+	}
+
+	void ICMP::Controller::dispatch(uint64_t now) {
+
+		// Process only the hosts with expired deadlines, the first one is the oldest.
+		uint64_t late = 0;
+		due.clear();
+
+		while(!deadlines.empty() && deadlines.top().time <= now) {
+
+			Deadline deadline = deadlines.top();
+			deadlines.pop();
+
+			Host *host = find(deadline.id);
+			if(!host || host->scheduled != deadline.time) {
+				continue;	// Stale entry.
+			}
+
+			if(due.empty()) {
+				late = now - deadline.time;
+			}
+
+			due.push_back(deadline.id);
+
+		}
+
+		delay = late;
+
+		if(budget.rate) {
+			// Serve the critical hosts first, the budget can run out on this tick.
+			std::stable_sort(due.begin(),due.end(),[this](uint32_t a, uint32_t b) {
+				return hosts[a].worker->getPriority() < hosts[b].worker->getPriority();
+			});
 		}
 
+		for(uint32_t id : due) {
+
+			Host &host = hosts[id];
+
+			if(now <= host.timeout && now >= host.next) {
+
+				// A probe is due.
+				if(host.worker->getPriority() == Worker::low && late > host.worker->interval()) {
+
+					// Overloaded, skip this probe instead of queueing it.
+					host.defer(now + host.worker->interval());
+					schedule(host);
+					skipped++;
+					continue;
+
+				}
+
+				if(!budget.take(now)) {
+
+					// Wait for the next token.
+					host.defer(now + budget.wait());
+					schedule(host);
+					continue;
+
+				}
+
+			}
+
+			if(host.onTimer(now)) {
+				schedule(host);
+			} else {
+				release(host);
+			}
+
+		}
+
+	}
+
+	void ICMP::Controller::Budget::setup(uint64_t r, uint64_t c) noexcept {
+		rate = r;
+		capacity = c;
+		tokens = c * 1000;
+		last = getMilliseconds();
+	}
+
+	bool ICMP::Controller::Budget::take(uint64_t now) noexcept {
+
+		if(!rate) {
+			return true;
+		}
+
+		if(now > last) {
+			tokens += (now - last) * rate;
+			if(tokens > capacity * 1000) {
+				tokens = capacity * 1000;
+			}
+			last = now;
+		}
+
+		if(tokens < 1000) {
+			return false;
+		}
+
+		tokens -= 1000;
+		return true;
+
+	}
+
+	uint64_t ICMP::Controller::Budget::wait() const noexcept {
+
+		if(!rate || tokens >= 1000) {
+			return 1;
+		}
+
+		uint64_t ms = ((1000 - tokens) + rate - 1) / rate;
+		return ms ? ms : 1;
+
+	}
+
+	void ICMP::Controller::schedule(Host &host) {
+
+		host.scheduled = host.deadline();
+		deadlines.push(Deadline{host.scheduled,host.id});
+
+
+	}
+
+	void ICMP::Controller::arm(uint64_t now) {
+
+		// Drop stale entries, no need to wake up for them.
+		while(!deadlines.empty()) {
+			const Deadline &deadline = deadlines.top();
+			Host *host = find(deadline.id);
+			if(host && host->scheduled == deadline.time) {
+				break;
+			}
+			deadlines.pop();
+		}
+
+		if(deadlines.empty()) {
+			wakeup = 0;
+			this->Timer::disable();
+			return;
+		}
+
+		wakeup = deadlines.top().time;
+		this->Timer::reset(wakeup > now ? (unsigned long) (wakeup - now) : 1UL);
+		if(!this->Timer::enabled()) {
+			this->Timer::enable();
+		}
+
+	}
+
+	void ICMP::Controller::start() {
+
+		try {
+
+			Logger::String{"Starting Listener"}.write(Logger::Trace,"ICMP");
+
+			// Create socket
+			if(Handler::values.fd <= 0) {
+
+				// Reference: https://github.com/schweikert/fping/blob/develop/src/socket4.c
+				protoent * proto = getprotobyname("icmp");
+				if(!proto) {
+					throw runtime_error("ICMP: Unknown protocol");
+				}
+
+				// Try an unprivileged ICMP datagram socket first, the kernel assigns the echo
+				// id and delivers only the replies for this socket (net.ipv4.ping_group_range).
+				Handler::values.fd = socket(AF_INET, SOCK_DGRAM, proto->p_proto);
+				if(Handler::values.fd >= 0) {
+
+					datagram = true;
+					Logger::String{"Using unprivileged ICMP datagram socket"}.write(Logger::Trace,"ICMP");
+
+					// ICMP errors for datagram sockets are only reported on the error queue.
+					int on = 1;
+					if(setsockopt(Handler::values.fd, SOL_IP, IP_RECVERR, &on, sizeof(on))) {
+						Logger::String{"Cant enable ICMP error queue: ",strerror(errno)}.write(Logger::Trace,"ICMP");
+					}
+
+				} else {
+
+					Logger::String{"Cant create ICMP datagram socket (",strerror(errno),"), using raw socket"}.write(Logger::Trace,"ICMP");
+
+					datagram = false;
+					Handler::values.fd = socket(AF_INET, SOCK_RAW, proto->p_proto);
+					if(Handler::values.fd < 0) {
+						throw std::system_error(errno, std::system_category(), "Cant create ICMP socket");
+					}
+
+					filter();
+
+				}
+
+				// Kernel software timestamps for sent and received packets, RTT doesn't depend on main loop latency.
+				int tsflags = SOF_TIMESTAMPING_SOFTWARE|SOF_TIMESTAMPING_RX_SOFTWARE|SOF_TIMESTAMPING_TX_SOFTWARE;
+				if(setsockopt(Handler::values.fd, SOL_SOCKET, SO_TIMESTAMPING, &tsflags, sizeof(tsflags))) {
+					Logger::String{"Kernel timestamps are not available: ",strerror(errno)}.write(Logger::Trace,"ICMP");
+				}
+
+				// Set non-blocking
+				int flags;
+
+				if ((flags = fcntl(Handler::values.fd, F_GETFL, 0)) < 0) {
+					throw std::system_error(errno, std::system_category(), "Cant get ICMP socket flags");
+				}
+
+				if (fcntl(Handler::values.fd, F_SETFL, flags | O_NONBLOCK) < 0){
+					throw std::system_error(errno, std::system_category(), "Cant set ICMP socket flags");
+				}
+
+				listening = true;
+
+			}
+
+#ifdef HAVE_LIBURING
+			// Completions of the ring replace the main loop watch of the socket.
+			if(!ring && Config::Value<bool>("network","icmp-uring",true)) {
+				ring = Ring::create(*this);
+			}
+			uring = (ring && ring->attach(Handler::values.fd));
+			if(uring) {
+				if(this->Handler::enabled()) {
+					this->Handler::disable();
+				}
+			} else
+#endif // HAVE_LIBURING
+			if(!this->Handler::enabled()) {
+				Logger::String{"Enabling listener"}.write(Logger::Debug,"ICMP");
+				this->Handler::enable();
+			}
+
+		} catch(...) {
+
+			stop();
+			throw;
+
+		}
+
+
+	}
+
+	void ICMP::Controller::push(Command::Action action, ICMP::Worker &worker) {
+
+		Command *command = new Command{action,&worker};
+
+		command->next = commands.load(memory_order_relaxed);
+		while(!commands.compare_exchange_weak(command->next,command,memory_order_release,memory_order_relaxed));
+
+	}
+
+	void ICMP::Controller::execute() {
+
+		// Take the whole stack at once and reverse it, commands run in the order they were pushed.
+		Command *command = commands.exchange(nullptr,memory_order_acquire);
+		Command *queue = nullptr;
+
+		while(command) {
+			Command *next = command->next;
+			command->next = queue;
+			queue = command;
+			command = next;
+		}
+
+		while(queue) {
+
+			command = queue;
+			queue = queue->next;
+
+			switch(command->action) {
+			case Command::insert:
+				attach(*command->worker);
+				break;
+
+			case Command::remove:
+				detach(*command->worker);
+				break;
+			}
+
+			delete command;
+
+		}
+
+	}
+
+	void ICMP::Controller::insert(ICMP::Worker &worker) {
+
+		if(worker.busy.exchange(true)) {
+			throw std::system_error(EBUSY, std::system_category(), "ICMP Listener is already active");
+		}
+
+		if(!listening) {
+
+			// Open the socket now, errors are reported to the caller.
+			try {
+
+				lock_guard<mutex> lock(guard);
+				start();
+
+			} catch(...) {
+
+				worker.busy = false;
+				throw;
+
+			}
+
+		}
+
+		worker.controller = this;
+		push(Command::insert,worker);
+
+		// Inserts arriving before the job runs share the same batch.
+		if(!pending.exchange(true)) {
+
+			ThreadPool::getInstance().push([this]() {
+
+				pending = false;
+
+				{
+					lock_guard<mutex> lock(guard);
+					execute();
+					flush();
+					if(!active) {
+						stop();
+					}
+				}
+
+				deliver();
+
+			});
+
+		}
+
+	}
+
+	void ICMP::Controller::attach(ICMP::Worker &worker) {
+
+		if(share(worker)) {
+			return;
+		}
+
+		if(available.empty() && hosts.size() >= UINT32_MAX) {
+			Logger::String{"Too many active ICMP hosts, ignoring ",std::to_string((const sockaddr_storage &) worker)}.warning("ICMP");
+			worker.busy = false;
+			return;
+		}
+
+		if(Handler::values.fd < 0) {
+
+			// The socket was closed after the insert, the table was empty.
+			try {
+
+				start();
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant start ICMP listener: ",e.what()}.error("ICMP");
+				worker.busy = false;
+				return;
+
+			}
+
+		}
+
+		if(worker.method == Worker::udp_datagram && udp.fd() < 0) {
+
+			try {
+
+				udp.start();
+
+			} catch(const std::exception &e) {
+
+				Logger::String{"Cant start UDP probes: ",e.what()}.error("ICMP");
+				worker.busy = false;
+				return;
+
+			}
+
+		}
+
+		if(worker.mtu && !dontfragment) {
+
+			// Set DF and ignore the kernel PMTU cache, probes larger than the cached MTU are sent.
+			int mode = IP_PMTUDISC_PROBE;
+			if(setsockopt(Handler::values.fd, SOL_IP, IP_MTU_DISCOVER, &mode, sizeof(mode))) {
+				Logger::String{"Cant set DF on ICMP socket: ",strerror(errno)}.warning("ICMP");
+			} else {
+				Logger::String{"Path MTU probes enabled on shard ",index}.write(Logger::Trace,"ICMP");
+			}
+			dontfragment = true;
+
+		}
+
+		uint32_t id;
+		if(!available.empty()) {
+			id = available.back();
+			available.pop_back();
+		} else {
+			id = (uint32_t) hosts.size();
+			hosts.emplace_back();
+		}
+
+		active++;
+
+		uint64_t now = getMilliseconds();
+
+		Host &host = hosts[id];
+		host.worker = &worker;
+		host.controller = this;
+		host.id = id;
+		host.token = ++tokens;
+		host.packets = 0;
+		host.timeout = now + worker.timeout();
+		host.answered = false;
+		host.backoff = host.srtt = host.rttvar = 0;
+
+		if(shareable(worker)) {
+			streams.emplace(hash(worker),id);
+		}
+
+		if(worker.method == Worker::udp_datagram && worker.ss_family == AF_INET) {
+			services.emplace(service(*((const sockaddr_in *) (const sockaddr_storage *) &worker),worker.port),id);
+		}
+
+		if(budget.take(now)) {
+			host.send(now);
+		} else {
+			// No token, the scheduler sends it by priority.
+			host.defer(now);
+		}
+
+		if(host.active()) {
+			schedule(host);
+			if(!wakeup || host.scheduled < wakeup) {
+				arm(now);
+			}
+		}
+
+	}
+
+	void ICMP::Controller::remove(ICMP::Worker &worker) {
+
+		// Queued behind any pending insert of the same worker, executed right now.
+		push(Command::remove,worker);
+
+		{
+			lock_guard<mutex> lock(guard);
+			execute();
+			if(!active) {
+				stop();
+			}
+		}
+
+		delivery.wait(worker);
+
+	}
+
+	bool ICMP::Controller::share(ICMP::Worker &worker) {
+
+		if(!shareable(worker)) {
+			return false;
+		}
+
+		uint32_t key = hash(worker);
+		auto range = streams.equal_range(key);
+
+		for(auto it = range.first; it != range.second;) {
+
+			Host *host = find(it->second);
+			if(!host || !shareable(*host->worker) || !same(*host->worker,worker)) {
+				if(!host || hash(*host->worker) != key) {
+					// Released, or the address of the worker changed.
+					it = streams.erase(it);
+				} else {
+					it++;
+				}
+				continue;
+			}
+
+			const ICMP::Worker &probe = *host->worker;
+			if(probe.length == worker.length && probe.priority == worker.priority
+				&& probe.timers.timeout == worker.timers.timeout
+				&& probe.timers.interval == worker.timers.interval
+				&& probe.timers.ceiling == worker.timers.ceiling) {
+
+				// The probe in flight, if any, counts for the new worker too.
+				host->subscribers.push_back(Host::Subscriber{
+					&worker,
+					(uint16_t) (host->packets ? (host->packets - worker.statistics.sent()) : 0)
+				});
+
+				if(Logger::enabled(Logger::Trace)) {
+					Logger::String{
+						std::to_string((const sockaddr_storage &) worker)," is already probed, sharing slot ",host->id,
+						" with ",host->subscribers.size()," other worker(s)"
+					}.write(Logger::Trace,"ICMP");
+				}
+
+				return true;
+
+			}
+
+			it++;
+
+		}
+
+		return false;
+
+	}
+
+	void ICMP::Controller::promote(Host &host) {
+
+		host.worker->busy = false;
+		host.worker = host.subscribers.front().worker;
+		host.subscribers.erase(host.subscribers.begin());
+
+		// Replies to the probes in flight were counted on the previous worker, start a new stream.
+		uint64_t now = getMilliseconds();
+		host.token = ++tokens;
+		host.packets = 0;
+		host.answered = false;
+		host.backoff = host.srtt = host.rttvar = 0;
+		host.next = now;
+		host.timeout = now + host.worker->timeout();
+
+		schedule(host);
+		if(!wakeup || host.scheduled < wakeup) {
+			arm(now);
+		}
+
+	}
+
+	void ICMP::Controller::detach(ICMP::Worker &worker) {
+
+		for(Host &host : hosts) {
+
+			if(!host.active()) {
+				continue;
+			}
+
+			if(host.worker == &worker) {
+				if(host.subscribers.empty()) {
+					release(host);
+				} else {
+					promote(host);
+				}
+				break;
+			}
+
+			auto subscriber = std::find_if(host.subscribers.begin(),host.subscribers.end(),[&worker](const Host::Subscriber &s){
+				return s.worker == &worker;
+			});
+
+			if(subscriber != host.subscribers.end()) {
+				host.subscribers.erase(subscriber);
+				worker.busy = false;
+				break;
+			}
+
+		}
+
+		delivery.drop(worker);
+
+		worker.controller = nullptr;
+
+	}
+
+	void ICMP::Controller::release(Host &host) noexcept {
+
+		if(!host.active()) {
+			return;
+		}
+
+		{
+			// Drop the stream, the entry of a worker whose address changed is removed by share().
+			auto range = streams.equal_range(hash(*host.worker));
+			for(auto it = range.first; it != range.second;) {
+				if(it->second == host.id) {
+					it = streams.erase(it);
+				} else {
+					it++;
+				}
+			}
+		}
+
+		if(host.worker->method == Worker::udp_datagram && host.worker->ss_family == AF_INET) {
+			auto range = services.equal_range(service(*((const sockaddr_in *) (const sockaddr_storage *) host.worker),host.worker->port));
+			for(auto it = range.first; it != range.second;) {
+				if(it->second == host.id) {
+					it = services.erase(it);
+				} else {
+					it++;
+				}
+			}
+		}
+
+		for(const Host::Subscriber &subscriber : host.subscribers) {
+			subscriber.worker->busy = false;
+		}
+		host.subscribers.clear();
+
+		host.worker->busy = false;
+		host.worker = nullptr;
+		available.push_back(host.id);
+		active--;
+
+	}
+
+	void ICMP::Controller::filter() noexcept {
+
+		// Accept echo replies with our id and error messages embedding one of our echo requests,
+		// everything else is dropped by the kernel before reaching the socket queue.
+		uint16_t id = ident;
+
+		struct sock_filter code[] = {
+			BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 0),						// X = IP header length
+			BPF_STMT(BPF_LD|BPF_B|BPF_IND, 0),						// A = icmp_type
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ICMP_ECHOREPLY, 0, 2),
+			BPF_STMT(BPF_LD|BPF_H|BPF_IND, 4),						// A = icmp_id
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, id, 12, 13),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ICMP_DEST_UNREACH, 1, 0),
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ICMP_TIME_EXCEEDED, 0, 11),
+			BPF_STMT(BPF_MISC|BPF_TXA, 0),							// A = offset of embedded IP header
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 8),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),
+			BPF_STMT(BPF_LD|BPF_B|BPF_IND, 0),						// A = embedded IP header length
+			BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0x0f),
+			BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 2),
+			BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+			BPF_STMT(BPF_MISC|BPF_TAX, 0),							// X = offset of embedded ICMP header
+			BPF_STMT(BPF_LD|BPF_H|BPF_IND, 4),						// A = embedded icmp_id
+			BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, id, 0, 1),
+			BPF_STMT(BPF_RET|BPF_K, 0xFFFF),						// Accept
+			BPF_STMT(BPF_RET|BPF_K, 0),								// Drop
+		};
+
+		struct sock_fprog program;
+		program.len = N_ELEMENTS(code);
+		program.filter = code;
+
+		if(setsockopt(Handler::values.fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program))) {
+			Logger::String{"Cant attach ICMP socket filter: ",strerror(errno)}.warning("ICMP");
+		}
+
+	}
+
+	void ICMP::Controller::Output::clear() noexcept {
+		packets.clear();
+		addr.clear();
+		lengths.clear();
+	}
+
+	uint16_t ICMP::Controller::sequence(const Payload &payload) {
+
+		uint16_t seq = ++output.sequence;
+
+		if(payload.ttl || payload.mtu) {
+			if(traces.empty()) {
+				traces.resize(UINT16_MAX+1);
+			}
+			Trace &trace = traces[seq];
+			trace.id = payload.id;
+			trace.token = payload.token;
+			trace.time = payload.time;
+			trace.ttl = payload.ttl;
+			trace.mtu = payload.mtu;
+		} else if(!traces.empty()) {
+			// The sequence wrapped, an error quoting only the header is for this probe.
+			traces[seq] = Trace{};
+		}
+
+		return seq;
+
+	}
+
+	void ICMP::Controller::send(const sockaddr_storage &addr, const Payload &payload, uint16_t length) {
+
+		if(Handler::values.fd < 0) {
+			throw runtime_error("ICMP Controller is not available");
+		}
+
+		switch(addr.ss_family) {
+		case AF_INET:
+			{
+				output.packets.push_back(output.model);
+				output.addr.push_back(addr);
+				output.lengths.push_back(length > sizeof(Packet) ? length : 0);
+
+				Packet &packet = output.packets.back();
+				packet.payload = payload;
+				packet.icmp.icmp_seq = htons(sequence(payload));
+
+				if(!datagram) {
+					// The kernel computes the checksum on datagram sockets.
+					packet.icmp.icmp_cksum = checksum(output.model,packet);
+				}
+			}
+			break;
+
+		case AF_INET6:
+			icmp6.send(addr,payload,length);
+			break;
+
+		default:
+			throw runtime_error(string{"Unsupported family: "} + std::to_string((int) addr.ss_family));
+		}
+
+	}
+
+	uint16_t ICMP::Controller::checksum(const Packet &model, const Packet &packet) noexcept {
+
+		// From the sequence to the end of the payload, the type, code and id are the model ones.
+		size_t offset = offsetof(struct icmp,icmp_seq);
+
+		return Checksum::update(
+			model.icmp.icmp_cksum,
+			((const uint8_t *) &model) + offset,
+			((const uint8_t *) &packet) + offset,
+			sizeof(Packet) - offset
+		);
+
+	}
+
+	void ICMP::Controller::flush() noexcept {
+		flush(output,Handler::values.fd);
+		flush(udp.output,udp.fd());
+		flush(icmp6.output,icmp6.fd());
+	}
+
+	bool ICMP::Controller::asynchronous(int code) noexcept {
+		switch(code) {
+		case ECONNREFUSED:
+		case EHOSTUNREACH:
+		case ENETUNREACH:
+		case EHOSTDOWN:
+		case EPROTO:
+			return true;
+		}
+		return false;
+	}
+
+	void ICMP::Controller::flush(Output &batch, int sock) noexcept {
+
+		if(batch.empty()) {
+			return;
+		}
+
+		if(sock < 0) {
+			batch.clear();
+			return;
+		}
+
+		// Build message headers only now, the packet vector is stable until the next send().
+		size_t length = batch.packets.size();
+
+		batch.msgs.resize(length);
+		batch.iov.resize(length * 2);
+		batch.control.resize(length);
+
+		for(size_t ix = 0; ix < length; ix++) {
+
+			struct iovec *iov = &batch.iov[ix * 2];
+
+			iov[0].iov_base = ((uint8_t *) &batch.packets[ix]) + batch.offset;
+			iov[0].iov_len = sizeof(Packet) - batch.offset;
+
+			memset(&batch.msgs[ix],0,sizeof(batch.msgs[ix]));
+			batch.msgs[ix].msg_hdr.msg_name = &batch.addr[ix];
+			batch.msgs[ix].msg_hdr.msg_namelen = (batch.addr[ix].ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+			batch.msgs[ix].msg_hdr.msg_iov = iov;
+			batch.msgs[ix].msg_hdr.msg_iovlen = 1;
+
+			if(ix < batch.lengths.size() && batch.lengths[ix]) {
+				// Larger probe, the rest of it is the shared padding.
+				iov[1].iov_base = (void *) padding;
+				iov[1].iov_len = batch.lengths[ix] - sizeof(Packet);
+				batch.msgs[ix].msg_hdr.msg_iovlen = 2;
+			}
+
+			if(batch.packets[ix].payload.ttl) {
+
+				// Path probe, set the TTL of this packet only.
+				struct msghdr &msg = batch.msgs[ix].msg_hdr;
+				msg.msg_control = batch.control[ix].buffer;
+				msg.msg_controllen = sizeof(batch.control[ix].buffer);
+
+				struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+				if(batch.addr[ix].ss_family == AF_INET6) {
+					cmsg->cmsg_level = IPPROTO_IPV6;
+					cmsg->cmsg_type = IPV6_HOPLIMIT;
+				} else {
+					cmsg->cmsg_level = IPPROTO_IP;
+					cmsg->cmsg_type = IP_TTL;
+				}
+				cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+				int ttl = batch.packets[ix].payload.ttl;
+				memcpy(CMSG_DATA(cmsg),&ttl,sizeof(ttl));
+
+			}
+
+		}
+
+		Logger::String(
+			"Sending ", length, (batch.offset ? " UDP" : " ICMP"), " packet(s)"
+#ifdef DEBUG
+			, " on socket ", sock
+#endif // DEBUG
+		).write(Logger::Debug,"ICMP");
+
+#ifdef HAVE_LIBURING
+		if(uring && &batch == &output && ring->send(batch,sock)) {
+			return;
+		}
+#endif // HAVE_LIBURING
+
+		// Move the batch out, error handlers can queue new packets.
+		vector<Packet> packets;
+		vector<sockaddr_storage> addr;
+		vector<uint16_t> lengths;
+		packets.swap(batch.packets);
+		addr.swap(batch.addr);
+		lengths.swap(batch.lengths);
+
+		transmit(sock,batch.msgs.data(),packets.data(),length);
+
+		// Keep the allocated space for the next batch.
+		if(batch.packets.empty()) {
+			packets.clear();
+			addr.clear();
+			lengths.clear();
+			batch.packets.swap(packets);
+			batch.addr.swap(addr);
+			batch.lengths.swap(lengths);
+		}
+
+	}
+
+	void ICMP::Controller::transmit(int sock, struct mmsghdr *msgs, const Packet *packets, size_t length) noexcept {
+
+		size_t sent = 0;
+		size_t retried = SIZE_MAX;
+		while(sent < length) {
+
+			int rc = sendmmsg(sock,msgs+sent,length-sent,0);
+
+			if(rc > 0) {
+				sent += rc;
+				continue;
+			}
+
+			if(rc < 0 && errno == EINTR) {
+				continue;
+			}
+
+			int code = (rc < 0 ? errno : EIO);
+
+			if(retried != sent && asynchronous(code)) {
+
+				// With IP_RECVERR every ICMP error received also sets the pending socket error, the
+				// next send fails with it whatever the destination. The failed call consumed it and
+				// the error itself is on the error queue; send the same packet again.
+				retried = sent;
+				continue;
+
+			}
+
+			// The packet at 'sent' was rejected, report it to the owner and skip it.
+
+			Host *host = find(packets[sent].payload);
+			if(host && host->onError(code,packets[sent].payload)) {
+				release(*host);
+			}
+
+			sent++;
+
+		}
 
 	}
 
@@ -0,0 +1,441 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/linux/icmp_uring.h>
+
+ #ifdef HAVE_LIBURING
+
+ #include <unistd.h>
+ #include <poll.h>
+ #include <sys/eventfd.h>
+ #include <linux/net_tstamp.h>
+ #include <linux/errqueue.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <cstring>
+
+ namespace Udjat {
+
+	ICMP::Controller::Ring::Ring(Controller &c) : MainLoop::Handler(-1, MainLoop::Handler::oninput), controller{c}, sending{0} {
+		memset(&header,0,sizeof(header));
+		header.msg_namelen = sizeof(sockaddr_storage);
+		header.msg_controllen = 128;
+	}
+
+	std::unique_ptr<ICMP::Controller::Ring> ICMP::Controller::Ring::create(Controller &controller) noexcept {
+
+		std::unique_ptr<Ring> ring{new Ring(controller)};
+
+		int rc = io_uring_queue_init(entries,&ring->uring,0);
+		if(rc < 0) {
+			Logger::String{"io_uring is not available: ",strerror(-rc)}.write(Logger::Trace,"ICMP");
+			return std::unique_ptr<Ring>();
+		}
+		ring->ready = true;
+
+		{
+			struct io_uring_probe *probe = io_uring_get_probe_ring(&ring->uring);
+			bool supported = probe
+				&& io_uring_opcode_supported(probe,IORING_OP_RECVMSG)
+				&& io_uring_opcode_supported(probe,IORING_OP_SENDMSG)
+				&& io_uring_opcode_supported(probe,IORING_OP_POLL_ADD)
+				&& io_uring_opcode_supported(probe,IORING_OP_ASYNC_CANCEL);
+
+			if(probe) {
+				io_uring_free_probe(probe);
+			}
+
+			if(!supported) {
+				Logger::String{"io_uring doesn't support the required operations"}.write(Logger::Trace,"ICMP");
+				return std::unique_ptr<Ring>();
+			}
+		}
+
+		// Provided buffers, the kernel picks one for every reply of the multishot receive.
+		ring->buffers.ring = io_uring_setup_buf_ring(&ring->uring,ring->buffers.count,ring->buffers.group,0,&rc);
+		if(!ring->buffers.ring) {
+			Logger::String{"io_uring buffer ring is not available: ",strerror(-rc)}.write(Logger::Trace,"ICMP");
+			return std::unique_ptr<Ring>();
+		}
+
+		ring->buffers.memory.resize(ring->buffers.count * ring->buffers.size);
+		for(unsigned int ix = 0; ix < ring->buffers.count; ix++) {
+			io_uring_buf_ring_add(
+				ring->buffers.ring,
+				ring->buffers.memory.data() + (ix * ring->buffers.size),
+				ring->buffers.size,
+				(unsigned short) ix,
+				io_uring_buf_ring_mask(ring->buffers.count),
+				(int) ix
+			);
+		}
+		io_uring_buf_ring_advance(ring->buffers.ring,ring->buffers.count);
+
+		ring->values.fd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+		if(ring->values.fd < 0 || io_uring_register_eventfd(&ring->uring,ring->values.fd)) {
+			Logger::String{"Cant watch io_uring completions: ",strerror(errno)}.write(Logger::Trace,"ICMP");
+			return std::unique_ptr<Ring>();
+		}
+
+		Logger::String{"Using io_uring on ICMP shard ",controller.index}.write(Logger::Trace,"ICMP");
+		return ring;
+
+	}
+
+	ICMP::Controller::Ring::~Ring() {
+
+		this->Handler::disable();
+		this->Handler::close();
+
+		if(ready) {
+			if(buffers.ring) {
+				io_uring_free_buf_ring(&uring,buffers.ring,buffers.count,buffers.group);
+			}
+			io_uring_queue_exit(&uring);
+		}
+
+	}
+
+	struct io_uring_sqe * ICMP::Controller::Ring::sqe() noexcept {
+
+		struct io_uring_sqe *entry = io_uring_get_sqe(&uring);
+		if(!entry) {
+			io_uring_submit(&uring);
+			entry = io_uring_get_sqe(&uring);
+		}
+		return entry;
+
+	}
+
+	bool ICMP::Controller::Ring::arm(Tag t) noexcept {
+
+		struct io_uring_sqe *entry = sqe();
+		if(!entry) {
+			return false;
+		}
+
+		if(t == receive) {
+			io_uring_prep_recvmsg_multishot(entry,sock,&header,0);
+			entry->flags |= IOSQE_BUFFER_SELECT;
+			entry->buf_group = buffers.group;
+		} else {
+			io_uring_prep_poll_multishot(entry,sock,POLLERR);
+		}
+
+		io_uring_sqe_set_data64(entry,tag(t,generation));
+		return true;
+
+	}
+
+	bool ICMP::Controller::Ring::attach(int s) noexcept {
+
+		if(sock == s) {
+			return true;
+		}
+
+		detach();
+
+		sock = s;
+		generation++;
+
+		if(!(arm(receive) && arm(errors)) || io_uring_submit(&uring) < 0) {
+			Logger::String{"Cant post io_uring receives, using the main loop"}.write(Logger::Trace,"ICMP");
+			sock = -1;
+			return false;
+		}
+
+		if(!this->Handler::enabled()) {
+			this->Handler::enable();
+		}
+
+		return true;
+
+	}
+
+	void ICMP::Controller::Ring::detach() noexcept {
+
+		if(sock < 0) {
+			return;
+		}
+
+		// The ring holds a reference to the socket until the multishot requests are gone.
+		for(Tag t : { receive, errors }) {
+			struct io_uring_sqe *entry = sqe();
+			if(entry) {
+				io_uring_prep_cancel64(entry,tag(t,generation),0);
+				io_uring_sqe_set_data64(entry,0);
+			}
+		}
+
+		io_uring_submit(&uring);
+		sock = -1;
+
+	}
+
+	bool ICMP::Controller::Ring::send(Output &batch, int s) noexcept {
+
+		if(s != sock || inflight) {
+			return false;
+		}
+
+		// The kernel reads the packets when the request runs, keep them until it completes.
+		sending.packets.swap(batch.packets);
+		sending.addr.swap(batch.addr);
+		sending.lengths.swap(batch.lengths);
+		sending.msgs.swap(batch.msgs);
+		sending.iov.swap(batch.iov);
+		sending.control.swap(batch.control);
+		batch.clear();
+
+		size_t length = sending.packets.size();
+		size_t first = 0;
+		for(size_t ix = 0; ix < length; ix++) {
+
+			struct io_uring_sqe *entry = io_uring_get_sqe(&uring);
+			if(!entry && submit(first)) {
+				entry = io_uring_get_sqe(&uring);
+			}
+
+			if(!entry) {
+				break;
+			}
+
+			io_uring_prep_sendmsg(entry,sock,&sending.msgs[ix].msg_hdr,0);
+			io_uring_sqe_set_data64(entry,tag(transmit,(uint32_t) ix));
+			queued.push_back(entry);
+			inflight++;
+
+		}
+
+		if(!queued.empty()) {
+			submit(first);
+		}
+
+		if(first < length) {
+			// The ring didn't take the rest of the batch, send it directly.
+			Logger::String{"Sending ",(length - first)," probe(s) with sendmmsg"}.write(Logger::Trace,"ICMP");
+			controller.transmit(sock,sending.msgs.data()+first,sending.packets.data()+first,length-first);
+		}
+
+		return true;
+
+	}
+
+	bool ICMP::Controller::Ring::submit(size_t &first) noexcept {
+
+		int rc = io_uring_submit(&uring);
+		if(rc >= 0) {
+			first += queued.size();
+			queued.clear();
+			return true;
+		}
+
+		Logger::String{"Error submitting ICMP probes: ",strerror(-rc)}.error("ICMP");
+
+		// The entries stay in the submission queue for the next io_uring_enter, the caller sends
+		// these packets itself.
+		for(struct io_uring_sqe *entry : queued) {
+			io_uring_prep_nop(entry);
+			io_uring_sqe_set_data64(entry,0);
+		}
+
+		inflight -= queued.size();
+		queued.clear();
+		return false;
+
+	}
+
+	/// @brief Get kernel software timestamp from a multishot receive, see ICMP::Controller::getCurrentTime().
+	static uint64_t timestamp(struct io_uring_recvmsg_out *out, struct msghdr &header) noexcept {
+
+		for(struct cmsghdr *cmsg = io_uring_recvmsg_cmsg_firsthdr(out,&header); cmsg; cmsg = io_uring_recvmsg_cmsg_nexthdr(out,&header,cmsg)) {
+			if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+				const struct scm_timestamping *ts = (const struct scm_timestamping *) CMSG_DATA(cmsg);
+				return ICMP::Controller::getCurrentTime(ts->ts[0]);
+			}
+		}
+
+		return 0;
+	}
+
+	size_t ICMP::Controller::Ring::process() {
+
+		size_t count = 0;
+		bool rearm[2] = { false, false };
+
+		struct io_uring_cqe *cqe;
+		while(!io_uring_peek_cqe(&uring,&cqe)) {
+
+			uint64_t data = io_uring_cqe_get_data64(cqe);
+			int res = cqe->res;
+			unsigned int flags = cqe->flags;
+			io_uring_cqe_seen(&uring,cqe);
+
+			Tag t = (Tag) (data >> 32);
+			uint32_t index = (uint32_t) data;
+
+			switch(t) {
+			case transmit:
+				if(res < 0 && index < sending.packets.size()) {
+					if(sock >= 0 && asynchronous(-res)) {
+						// Probably the pending error of an earlier packet, as in transmit(); send it again.
+						controller.transmit(sock,sending.msgs.data()+index,sending.packets.data()+index,1);
+					} else {
+						const Payload &payload = sending.packets[index].payload;
+						Host *host = controller.find(payload);
+						if(host && host->onError(-res,payload)) {
+							controller.release(*host);
+						}
+					}
+				}
+				if(inflight && !--inflight) {
+					sending.clear();
+				}
+				break;
+
+			case receive:
+				{
+					bool current = (index == generation && sock >= 0);
+
+					if(flags & IORING_CQE_F_BUFFER) {
+
+						unsigned short bid = (unsigned short) (flags >> IORING_CQE_BUFFER_SHIFT);
+						uint8_t *buffer = buffers.memory.data() + (bid * buffers.size);
+
+						struct io_uring_recvmsg_out *out = (current && res > 0) ? io_uring_recvmsg_validate(buffer,res,&header) : nullptr;
+						if(out) {
+
+							sockaddr_storage addr;
+							memset(&addr,0,sizeof(addr));
+							memcpy(&addr,io_uring_recvmsg_name(out),std::min((size_t) out->namelen,sizeof(addr)));
+
+							uint64_t time = timestamp(out,header);
+							controller.receive(
+								(const uint8_t *) io_uring_recvmsg_payload(out,&header),
+								io_uring_recvmsg_payload_length(out,res,&header),
+								addr,
+								time ? time : getCurrentTime()
+							);
+							count++;
+
+						}
+
+						// Give the buffer back to the kernel.
+						io_uring_buf_ring_add(buffers.ring,buffer,buffers.size,bid,io_uring_buf_ring_mask(buffers.count),0);
+						io_uring_buf_ring_advance(buffers.ring,1);
+
+					}
+
+					if(current && !(flags & IORING_CQE_F_MORE)) {
+						if(res == -EINVAL) {
+							// Multishot recvmsg needs Linux 6.0.
+							Logger::String{"Multishot receive is not supported, using the main loop"}.write(Logger::Trace,"ICMP");
+							detach();
+							controller.fallback();
+						} else {
+							// Out of buffers or interrupted, post it again.
+							rearm[0] = true;
+						}
+					}
+				}
+				break;
+
+			case errors:
+				if(index == generation && sock >= 0) {
+					if(res > 0) {
+						controller.drain(MSG_ERRQUEUE);
+					}
+					if(!(flags & IORING_CQE_F_MORE)) {
+						rearm[1] = true;
+					}
+				}
+				break;
+
+			default:
+				// Cancel requests.
+				break;
+
+			}
+
+		}
+
+		if(sock >= 0 && (rearm[0] || rearm[1])) {
+			if(rearm[0]) {
+				arm(receive);
+			}
+			if(rearm[1]) {
+				arm(errors);
+			}
+			io_uring_submit(&uring);
+		}
+
+		return count;
+
+	}
+
+	void ICMP::Controller::Ring::handle_event(const Event) {
+
+		uint64_t value;
+		if(::read(values.fd,&value,sizeof(value)) < 0 && errno != EAGAIN) {
+			Logger::String{"Error reading io_uring eventfd: ",strerror(errno)}.error("ICMP");
+		}
+
+		auto run = [this]() {
+
+			controller.received.update(process());
+
+		};
+
+		if(controller.threaded) {
+
+			this->Handler::disable();
+
+			ThreadPool::getInstance().push([this,run]() {
+				{
+					lock_guard<mutex> lock(controller.guard);
+					run();
+					if(values.fd >= 0) {
+						this->Handler::enable();
+					}
+				}
+				controller.deliver();
+			});
+
+			return;
+		}
+
+		{
+			lock_guard<mutex> lock(controller.guard);
+			run();
+		}
+		controller.deliver();
+
+	}
+
+	void ICMP::Controller::fallback() noexcept {
+		uring = false;
+		if(Handler::values.fd >= 0 && !this->Handler::enabled()) {
+			this->Handler::enable();
+		}
+	}
+
+ }
+
+ #endif // HAVE_LIBURING
@@ -20,94 +20,177 @@
  #include <config.h>
  #include <udjat/defs.h>
  #include <private/linux/icmp_controller.h>
- #include <linux/icmp.h>
 
  namespace Udjat {
 
-#if __cplusplus >= 201703L			
-	ICMP::Controller::Host::Host(ICMP::Worker &w) : worker{w} {
-		static uint16_t id = 0;
-		this->id = id++;
-		timeout = time(0) + worker.interval();
-		send();
-	}
-#else
-	ICMP::Controller::Host::Host(std::shared_ptr<ICMP::Worker> &w) {
-		worker = w;
-		static uint16_t id = 0;
-		this->id = id++;
-		timeout = time(0) + worker.interval();
-		send();
+	void ICMP::Controller::Host::post(const ICMP::Response response, const sockaddr_storage &from) {
+		controller->post(*worker,response,from);
+		for(const Subscriber &subscriber : subscribers) {
+			controller->post(*subscriber.worker,response,from);
+		}
 	}
-#endif // C++17
 
-	bool ICMP::Controller::Host::onTimer() {
+	void ICMP::Controller::Host::received(uint16_t seq, uint64_t rtt) noexcept {
+		worker->statistics.received(seq,rtt);
+		for(const Subscriber &subscriber : subscribers) {
+			subscriber.worker->statistics.received((uint16_t) (seq - subscriber.delta),rtt);
+		}
+	}
 
- 		time_t now = ::time(0);
+	bool ICMP::Controller::Host::onTimer(uint64_t now) {
 
 		if(now > timeout) {
-			worker.set(Response::timeout,IP::Address{});
+			post(Response::timeout,IP::Address{});
 			return false;
 		}
 
 		if(now >= next) {
-			send();
+			send(now);
 		}
 
 		return true;
 	}
 
+	void ICMP::Controller::Host::defer(uint64_t when) noexcept {
+
+		next = when;
+
+		// Don't report a timeout for a probe that wasn't sent.
+		if(timeout < (when + worker->timeout())) {
+			timeout = when + worker->timeout();
+		}
+
+	}
+
 	bool ICMP::Controller::Host::onError(int code, const Controller::Payload &payload) {
 
-		if(payload.id == this->id) {
+		if(payload.id != this->id || payload.token != this->token || payload.ttl) {
+			return false;
+		}
+
+		if(payload.mtu) {
+			// Path MTU probe larger than the interface MTU.
+			if(code == EMSGSIZE && worker->mtu) {
+				worker->mtu->failed(payload.mtu);
+			}
+			return false;
+		}
+
+		switch(code) {
+		case ENETUNREACH:	// Network is unreachable
+			post(Response::network_unreachable,IP::Address{});
+			return true;
+
+		default:
+			cerr << "icmp\tError '" << strerror(code) << "' searching " << *worker << endl;
+
+		}
+
+		return false;
+	}
+
+	bool ICMP::Controller::Host::onDatagram(int code, const sockaddr_storage &from, const Payload &payload, uint64_t time) noexcept {
+
+		if(payload.id != this->id || payload.token != this->token) {
+			return false;
+		}
+
+		try {
 
 			switch(code) {
-			case ENETUNREACH:	// Network is unreachable
-				worker.set(Response::network_unreachable,IP::Address{});
-				return true;
+			case 0:				// Reply from the service.
+			case ECONNREFUSED:	// Port unreachable, the host is up.
+				{
+					// A reply before the probe isn't a sample, the host is up anyway.
+					uint64_t rtt = (time > payload.time ? (time - payload.time) : 0);
+					if(rtt) {
+						received(payload.seq,rtt);
+					}
 
-			default:
-				cerr << "icmp\tError '" << strerror(code) << "' searching " << worker << endl;
+					post((code ? Response::destination_unreachable : Response::echo_reply),from);
+
+					if(adapt(rtt,payload.seq == packets)) {
+						return false;
+					}
+				}
+				break;
+
+			case ENETUNREACH:
+				post(Response::network_unreachable,from);
+				break;
+
+			default:			// Host unreachable, prohibited, ...
+				post(Response::destination_unreachable,from);
 
 			}
 
+		} catch(const exception &e) {
+
+			cerr << "Error processing UDP answer from " << from << ": " << e.what() << endl;
+
 		}
 
-		return false;
+		return true;
+
 	}
 
-	bool ICMP::Controller::Host::onResponse(int icmp_type, const sockaddr_storage &addr, const Payload &payload) noexcept {
+	bool ICMP::Controller::Host::onResponse(int icmp_type, const sockaddr_storage &addr, const Payload &payload, uint64_t time) noexcept {
 
-		if(payload.id != this->id) {
+		if(payload.id != this->id || payload.token != this->token) {
 			return false;
 		}
 
 		try {
 
+			if(payload.mtu) {
+
+				// Path MTU probe reaching the host.
+				if(icmp_type == ICMP_ECHOREPLY && worker->mtu) {
+					worker->mtu->passed(payload.mtu);
+				}
+
+				return false;
+			}
+
+			if(payload.ttl) {
+
+				// Path probe reaching the host.
+				if(icmp_type == ICMP_ECHOREPLY && worker->path && time > payload.time) {
+					worker->path->received(payload.ttl,addr,time - payload.time,true);
+				}
+
+				return false;
+			}
+
 			switch(icmp_type) {
 			case ICMP_ECHO: // Received my own Echo Request, ignore it.
 				return false;
 
 			case ICMP_ECHOREPLY: // Echo Reply
 				{
-					uint64_t now = ICMP::Controller::getCurrentTime();
+					// Use the kernel transmit time when it was reported for this probe.
+					uint64_t start = (sent && payload.seq == packets) ? sent : payload.time;
 
-					if(payload.time >= now) {
-						worker.time = (payload.time - now);
-					} else {
-						worker.time = (now - payload.time);
+					// A reply before the probe isn't a sample, the host is up anyway.
+					uint64_t rtt = (time > start ? (time - start) : 0);
+					if(rtt) {
+						received(payload.seq,rtt);
 					}
 
-					worker.set(Response::echo_reply,addr);
+					post(((worker->mtu && worker->mtu->reduced()) ? Response::mtu_reduced : Response::echo_reply),addr);
+
+					if(adapt(rtt,payload.seq == packets)) {
+						return false;
+					}
 				}
 				break;
 
 			case ICMP_DEST_UNREACH: // Destination Unreachable
-				worker.set(Response::destination_unreachable,addr);
+				post(Response::destination_unreachable,addr);
 				break;
 
 			case ICMP_TIME_EXCEEDED: // Time Exceeded
-				worker.set(Response::time_exceeded,addr);
+				post(Response::time_exceeded,addr);
 				break;
 
 			default:
@@ -124,20 +207,109 @@
 
 	}
 
-	void ICMP::Controller::Host::send() noexcept {
+	bool ICMP::Controller::Host::adapt(uint64_t rtt, bool latest) noexcept {
+
+		if(!worker->adaptive()) {
+
+			if(!worker->path && !worker->mtu) {
+				return false;
+			}
+
+			// Path and MTU probing are continuous, next round on the normal interval.
+			if(latest) {
+				answered = true;
+			}
+			timeout = next + worker->timeout();
+			return true;
+
+		}
+
+		// Smoothed RTT and variation (RFC 6298), a sample far from the average is a deviation.
+		bool deviation = false;
+		if(!rtt) {
+			// Dropped sample, keep the averages.
+		} else if(!srtt) {
+			srtt = rtt;
+			rttvar = rtt / 2;
+		} else {
+			uint64_t delta = (rtt > srtt ? rtt - srtt : srtt - rtt);
+			deviation = delta > ((4 * rttvar) + 1000000);
+			rttvar = ((3 * rttvar) + delta) / 4;
+			srtt = ((7 * srtt) + rtt) / 8;
+		}
+
+		if(latest) {
+			answered = true;
+		}
+
+		if(!latest || deviation || !backoff) {
+			backoff = worker->interval();
+		} else {
+			backoff *= 2;
+			if(backoff > worker->timers.ceiling) {
+				backoff = worker->timers.ceiling;
+			}
+		}
+
+		uint64_t now = getMilliseconds();
+		next = now + backoff;
+		timeout = next + worker->timeout();
+
+		return true;
+
+	}
+
+	void ICMP::Controller::Host::send(uint64_t now) noexcept {
 
 		try {
 
 			Payload packet;
 
-			next = ::time(0) + worker.interval();
+			if(!answered) {
+				// Retry or first probe, back to the fast interval.
+				backoff = 0;
+			}
+
+			next = now + worker->interval();
+			sent = 0;
+			answered = false;
 
 			memset(&packet,0,sizeof(packet));
 			packet.id 	= this->id;
-			packet.seq	= ++this->packets;
+			packet.token = this->token;
+			packet.seq	= this->packets = worker->statistics.sent();
+
+			for(Subscriber &subscriber : subscribers) {
+				subscriber.delta = (uint16_t) (packets - subscriber.worker->statistics.sent());
+			}
 			packet.time = getCurrentTime();
 
-			Controller::getInstance().send(worker,packet);
+			if(worker->method == Worker::udp_datagram) {
+				// No transmit timestamps on the UDP socket, answers are timed from the payload.
+				sent = packet.time;
+				controller->send(*worker,worker->port,packet);
+				return;
+			}
+
+			controller->send(*worker,packet,worker->length);
+
+			if(worker->mtu && worker->ss_family == AF_INET) {
+				// One path MTU probe per round, the size includes the IP header.
+				Payload probe = packet;
+				probe.mtu = worker->mtu->next();
+				controller->send(*worker,probe,(uint16_t) (probe.mtu - sizeof(struct iphdr)));
+			}
+
+			if(worker->path) {
+
+				// Probe round, every hop at once.
+				worker->path->sent();
+				for(uint8_t ttl = 1; ttl <= worker->path->size(); ttl++) {
+					packet.ttl = ttl;
+					controller->send(*worker,packet);
+				}
+
+			}
 
 		} catch(const exception &e) {
 
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * ICMPv6 echo requests share the host table, scheduler, sequence and send batches of the
+  * ICMP controller. The messages are the same with other type numbers; raw ICMPv6 sockets
+  * deliver them without the IP header and the kernel computes the checksum, the pseudo
+  * header includes the source address.
+  */
+
+ #include <config.h>
+ #include <private/linux/icmp_controller.h>
+
+ #include <unistd.h>
+ #include <sys/types.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <netinet/ip6.h>
+ #include <netinet/icmp6.h>
+ #include <linux/net_tstamp.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <system_error>
+ #include <algorithm>
+ #include <cstring>
+
+ namespace Udjat {
+
+	void ICMP::Controller::ICMPv6::start() {
+
+		if(values.fd >= 0) {
+			return;
+		}
+
+		values.fd = socket(AF_INET6, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, IPPROTO_ICMPV6);
+		if(values.fd >= 0) {
+
+			datagram = true;
+			Logger::String{"Using unprivileged ICMPv6 datagram socket"}.write(Logger::Trace,"ICMP");
+
+			// ICMP errors for datagram sockets are only reported on the error queue.
+			int on = 1;
+			if(setsockopt(values.fd, SOL_IPV6, IPV6_RECVERR, &on, sizeof(on))) {
+				Logger::String{"Cant enable ICMPv6 error queue: ",strerror(errno)}.write(Logger::Trace,"ICMP");
+			}
+
+		} else {
+
+			Logger::String{"Cant create ICMPv6 datagram socket (",strerror(errno),"), using raw socket"}.write(Logger::Trace,"ICMP");
+
+			datagram = false;
+			values.fd = socket(AF_INET6, SOCK_RAW|SOCK_NONBLOCK|SOCK_CLOEXEC, IPPROTO_ICMPV6);
+			if(values.fd < 0) {
+				throw std::system_error(errno, std::system_category(), "Cant create ICMPv6 socket");
+			}
+
+			// Echo replies and the errors answering echo requests, the id is checked on receive.
+			struct icmp6_filter filter;
+			ICMP6_FILTER_SETBLOCKALL(&filter);
+			ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY,&filter);
+			ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH,&filter);
+			ICMP6_FILTER_SETPASS(ICMP6_PACKET_TOO_BIG,&filter);
+			ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED,&filter);
+
+			if(setsockopt(values.fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter))) {
+				Logger::String{"Cant attach ICMPv6 socket filter: ",strerror(errno)}.warning("ICMP");
+			}
+
+		}
+
+		// Kernel software timestamps, as on the ICMP socket.
+		int tsflags = SOF_TIMESTAMPING_SOFTWARE|SOF_TIMESTAMPING_RX_SOFTWARE|SOF_TIMESTAMPING_TX_SOFTWARE;
+		if(setsockopt(values.fd, SOL_SOCKET, SO_TIMESTAMPING, &tsflags, sizeof(tsflags))) {
+			Logger::String{"Kernel timestamps are not available: ",strerror(errno)}.write(Logger::Trace,"ICMP");
+		}
+
+		Logger::String{"ICMPv6 probes enabled on shard ",controller.index}.write(Logger::Trace,"ICMP");
+		enable();
+
+	}
+
+	void ICMP::Controller::ICMPv6::stop() noexcept {
+
+		output.clear();
+
+		if(values.fd >= 0) {
+			disable();
+			close();
+		}
+
+	}
+
+	void ICMP::Controller::ICMPv6::send(const sockaddr_storage &addr, const Payload &payload, uint16_t length) {
+
+		start();
+
+		struct icmp6_hdr header;
+		memset(&header,0,sizeof(header));
+		header.icmp6_type = ICMP6_ECHO_REQUEST;
+		header.icmp6_id = htons(controller.ident);
+		header.icmp6_seq = htons(controller.sequence(payload));
+
+		output.packets.emplace_back();
+		memcpy(((uint8_t *) &output.packets.back()) + output.offset,&header,sizeof(header));
+		output.packets.back().payload = payload;
+
+		output.addr.push_back(addr);
+
+		// The length is of the ICMP message, the packet is sent from the offset.
+		output.lengths.push_back(length ? (uint16_t) (length + output.offset) : 0);
+
+	}
+
+	void ICMP::Controller::ICMPv6::handle_event(const Event) {
+
+		auto read = [this]() {
+			// Transmit timestamps and errors first, as on the ICMP socket.
+			controller.drain(*this,MSG_ERRQUEUE);
+			controller.drain(*this,0);
+		};
+
+		if(controller.threaded) {
+
+			this->Handler::disable();
+
+			ThreadPool::getInstance().push([this,read]() {
+				{
+					lock_guard<mutex> lock(controller.guard);
+					read();
+					if(values.fd >= 0) {
+						this->Handler::enable();
+					}
+				}
+				controller.deliver();
+			});
+
+			return;
+		}
+
+		{
+			lock_guard<mutex> lock(controller.guard);
+			read();
+		}
+		controller.deliver();
+
+	}
+
+	bool ICMP::Controller::translate(uint8_t &type, uint8_t &code) noexcept {
+
+		switch(type) {
+		case ICMP6_DST_UNREACH:
+			code = (code == ICMP6_DST_UNREACH_NOROUTE ? ICMP_NET_UNREACH : ICMP_HOST_UNREACH);
+			type = ICMP_DEST_UNREACH;
+			return true;
+
+		case ICMP6_PACKET_TOO_BIG:
+			code = ICMP_FRAG_NEEDED;
+			type = ICMP_DEST_UNREACH;
+			return true;
+
+		case ICMP6_TIME_EXCEEDED:
+			code = ICMP_EXC_TTL;
+			type = ICMP_TIME_EXCEEDED;
+			return true;
+
+		}
+
+		return false;
+
+	}
+
+	void ICMP::Controller::receive6(const uint8_t *data, size_t length, const sockaddr_storage &addr, uint64_t time) {
+
+		if(length < sizeof(struct icmp6_hdr)) {
+			return;
+		}
+
+		struct icmp6_hdr header;
+		memcpy(&header,data,sizeof(header));
+
+		if(header.icmp6_type == ICMP6_ECHO_REPLY) {
+
+			// The kernel already matched the socket id on datagram sockets.
+			if(length < (sizeof(header) + sizeof(Payload)) || (!icmp6.datagram && ntohs(header.icmp6_id) != ident)) {
+				return;
+			}
+
+			Payload payload;
+			memcpy(&payload,data+sizeof(header),sizeof(payload));
+
+			Host *host = find(payload);
+			if(host) {
+				response(*host,ICMP_ECHOREPLY,addr,payload,time);
+			}
+
+			return;
+		}
+
+		uint8_t type = header.icmp6_type;
+		uint8_t code = header.icmp6_code;
+		if(!translate(type,code)) {
+			return;
+		}
+
+		// Errors quote the original IPv6 header, echo requests are sent without extension headers.
+		size_t offset = sizeof(header) + sizeof(struct ip6_hdr);
+		if(length < (offset + sizeof(struct icmp6_hdr))) {
+			return;
+		}
+
+		struct ip6_hdr ip6;
+		memcpy(&ip6,data+sizeof(header),sizeof(ip6));
+		if(ip6.ip6_nxt != IPPROTO_ICMPV6) {
+			return;
+		}
+
+		struct icmp6_hdr echo;
+		memcpy(&echo,data+offset,sizeof(echo));
+		if(echo.icmp6_type != ICMP6_ECHO_REQUEST || (!icmp6.datagram && ntohs(echo.icmp6_id) != ident)) {
+			return;
+		}
+
+		offset += sizeof(echo);
+
+		original(
+			type,
+			code,
+			(uint16_t) std::min(ntohl(header.icmp6_mtu),(uint32_t) UINT16_MAX),
+			ntohs(echo.icmp6_seq),
+			data+offset,
+			length-offset,
+			addr,
+			time
+		);
+
+	}
+
+ }
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+ #include <config.h>
+ #include <udjat/defs.h>
+ #include <udjat/net/icmp.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <memory>
+ #include <mutex>
+
+ using namespace std;
+
+ namespace Udjat {
+
+	namespace {
+
+		/// @brief Addresses probed by one ICMP::ping() call.
+		class Batch {
+		private:
+
+			class Probe : public ICMP::Worker {
+			private:
+				Batch &batch;
+				const size_t index;
+
+			public:
+				bool answered = false;
+
+				Probe(Batch &b, size_t i, const ICMP::Options &options)
+					: ICMP::Worker{Timers{options.timeout,(options.interval ? options.interval : (options.timeout+1))},options.priority}, batch{b}, index{i} {
+					static_cast<IP::Address &>(*this) = b.replies[i].address;
+				}
+
+				~Probe() override {
+					// Stop before the worker is gone, set() can't be called on a partially destroyed probe.
+					stop();
+				}
+
+				inline void start() {
+					ICMP::Worker::start();
+				}
+
+				void set(const ICMP::Response response, const IP::Address &from) override {
+					batch.set(*this,index,response,from);
+				}
+
+			};
+
+			mutex guard;
+
+			/// @brief Probes without an answer.
+			size_t pending = 0;
+
+			const std::function<void(std::vector<ICMP::Reply> &replies)> callback;
+
+			/// @brief Keeps the batch alive until the last answer.
+			shared_ptr<Batch> self;
+
+			vector<ICMP::Reply> replies;
+
+			/// @brief Destroyed first, stopping the probes before the replies go away.
+			vector<unique_ptr<Probe>> probes;
+
+			void set(Probe &probe, size_t index, const ICMP::Response response, const IP::Address &from) {
+
+				shared_ptr<Batch> done;
+
+				{
+					lock_guard<mutex> lock(guard);
+
+					if(probe.answered) {
+						return;
+					}
+					probe.answered = true;
+
+					ICMP::Reply &reply = replies[index];
+					reply.response = response;
+					reply.from = from;
+					if(response == ICMP::echo_reply || response == ICMP::mtu_reduced) {
+						reply.rtt = probe.getStatistics().last;
+					}
+
+					if(--pending) {
+						return;
+					}
+
+					done.swap(self);
+				}
+
+				// The worker is being notified, destroy it on another job.
+				finish(done);
+
+			}
+
+			static void finish(shared_ptr<Batch> batch) {
+				ThreadPool::getInstance().push([batch]() {
+					try {
+						batch->callback(batch->replies);
+					} catch(const std::exception &e) {
+						Logger::String{"Error processing ping replies: ",e.what()}.error("ICMP");
+					}
+				});
+			}
+
+		public:
+
+			Batch(const IP::Address *addresses, size_t count, const std::function<void(std::vector<ICMP::Reply> &replies)> &c)
+				: callback{c}, replies(count) {
+				for(size_t ix = 0; ix < count; ix++) {
+					replies[ix].address = addresses[ix];
+				}
+			}
+
+			static void start(const IP::Address *addresses, size_t count, const std::function<void(std::vector<ICMP::Reply> &replies)> &callback, const ICMP::Options &options) {
+
+				shared_ptr<Batch> batch = make_shared<Batch>(addresses,count,callback);
+				batch->probes.reserve(count);
+
+				for(size_t ix = 0; ix < count; ix++) {
+					const sockaddr_storage &addr = batch->replies[ix].address;
+					if(addr.ss_family == AF_INET || addr.ss_family == AF_INET6) {
+						batch->probes.emplace_back(new Probe(*batch,ix,options));
+					}
+				}
+
+				if(batch->probes.empty()) {
+					finish(batch);
+					return;
+				}
+
+				{
+					lock_guard<mutex> lock(batch->guard);
+					batch->self = batch;
+					batch->pending = batch->probes.size();
+				}
+
+				try {
+
+					for(auto &probe : batch->probes) {
+						probe->start();
+					}
+
+				} catch(...) {
+
+					// Answers already delivered can't complete the batch, it's going away.
+					{
+						lock_guard<mutex> lock(batch->guard);
+						batch->self.reset();
+						batch->pending = SIZE_MAX;
+					}
+					batch->probes.clear();
+					throw;
+
+				}
+
+			}
+
+		};
+
+	}
+
+	void ICMP::ping(const IP::Address *addresses, size_t count, const std::function<void(std::vector<Reply> &replies)> &callback, const Options &options) {
+		Batch::start(addresses,count,callback,options);
+	}
+
+	std::future<std::vector<ICMP::Reply>> ICMP::ping(const std::vector<IP::Address> &addresses, const Options &options) {
+
+		auto promise = make_shared<std::promise<std::vector<Reply>>>();
+		auto future = promise->get_future();
+
+		ping(addresses.data(),addresses.size(),[promise](std::vector<Reply> &replies) {
+			promise->set_value(std::move(replies));
+		},options);
+
+		return future;
+
+	}
+
+ }
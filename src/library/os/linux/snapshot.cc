@@ -0,0 +1,565 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+ #include <config.h>
+ #include <private/linux/snapshot.h>
+ #include <udjat/net/dns/agent.h>
+ #include <udjat/tools/configuration.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <netinet/in.h>
+ #include <algorithm>
+ #include <vector>
+ #include <cstring>
+ #include <ctime>
+
+ namespace Udjat {
+
+	constexpr const char IP::Snapshot::magic[8];
+
+	/// @brief FNV-1a hash of a string, continuing from a previous value.
+	static uint64_t hash(const char *str, uint64_t value = 14695981039346656037ULL) noexcept {
+		while(str && *str) {
+			value ^= (uint8_t) *(str++);
+			value *= 1099511628211ULL;
+		}
+		return value;
+	}
+
+	/// @brief Store the IP of an address on a record.
+	static void store(uint8_t &family, uint8_t *to, const sockaddr_storage &addr) noexcept {
+
+		family = (uint8_t) addr.ss_family;
+		memset(to,0,16);
+
+		switch(addr.ss_family) {
+		case AF_INET:
+			memcpy(to,&((const sockaddr_in *) &addr)->sin_addr,sizeof(in_addr));
+			break;
+
+		case AF_INET6:
+			memcpy(to,&((const sockaddr_in6 *) &addr)->sin6_addr,sizeof(in6_addr));
+			break;
+
+		default:
+			family = 0;
+		}
+
+	}
+
+	/// @brief Get the address stored on a record.
+	static sockaddr_storage address(uint8_t family, const uint8_t *from) noexcept {
+
+		sockaddr_storage addr;
+		memset(&addr,0,sizeof(addr));
+		addr.ss_family = family;
+
+		if(family == AF_INET) {
+			memcpy(&((sockaddr_in *) &addr)->sin_addr,from,sizeof(in_addr));
+		} else if(family == AF_INET6) {
+			memcpy(&((sockaddr_in6 *) &addr)->sin6_addr,from,sizeof(in6_addr));
+		}
+
+		return addr;
+	}
+
+	IP::Snapshot & IP::Snapshot::getInstance() {
+		static Snapshot instance;
+		return instance;
+	}
+
+	IP::Snapshot::Snapshot()
+		: filename{Config::Value<std::string>("network","snapshot","")},
+			age{Config::Value<unsigned int>("network","snapshot-max-age",3600)},
+			interval{Config::Value<unsigned int>("network","snapshot-interval",300) * 1000UL} {
+
+		if(!filename.empty()) {
+			Logger::String{"Agent snapshot is ",filename.c_str()}.write(Logger::Trace,"snapshot");
+		}
+
+	}
+
+	IP::Snapshot::~Snapshot() {
+
+		// Static destructor, the agents were saved by stop() and the main loop can be gone;
+		// don't touch the timer.
+		timer.release();
+
+		lock_guard<mutex> lock(guard);
+		unload();
+
+	}
+
+	IP::Snapshot::Timer::Timer(Snapshot &s) : MainLoop::Timer{s.interval}, snapshot{s} {
+		MainLoop::Timer::enable();
+	}
+
+	void IP::Snapshot::Timer::on_timer() {
+
+		// Capture on the main loop, with the agents; don't stall it writing the file.
+		uint64_t number;
+		auto records = make_shared<vector<Record>>(snapshot.collect(number));
+
+		Snapshot *instance = &snapshot;
+		ThreadPool::getInstance().push([instance,records,number]() {
+			instance->write(*records,number);
+		});
+
+	}
+
+	void IP::Snapshot::stop() {
+
+		if(filename.empty()) {
+			return;
+		}
+
+		timer.reset();
+
+		// Module deinit, the last state of the agents.
+		save();
+
+		lock_guard<mutex> lock(guard);
+		for(auto &it : entries) {
+			it.second.agent = nullptr;
+		}
+
+	}
+
+	uint64_t IP::Snapshot::path(const pugi::xml_node &node) noexcept {
+
+		std::vector<const char *> names;
+		for(pugi::xml_node parent = node.parent(); parent; parent = parent.parent()) {
+			const char *name = parent.attribute("name").as_string();
+			if(*name) {
+				names.push_back(name);
+			}
+		}
+
+		// From the root, as '/parent/child'.
+		uint64_t value = hash(nullptr);
+		for(auto it = names.rbegin(); it != names.rend(); it++) {
+			value = hash("/",value);
+			value = hash(*it,value);
+		}
+
+		return value;
+
+	}
+
+	void IP::Snapshot::load() noexcept {
+
+		if(file.loaded) {
+			return;
+		}
+		file.loaded = true;
+
+		int fd = open(filename.c_str(),O_RDONLY|O_CLOEXEC);
+		if(fd < 0) {
+			if(errno != ENOENT) {
+				Logger::String{"Cant open ",filename.c_str(),": ",strerror(errno)}.warning("snapshot");
+			}
+			return;
+		}
+
+		struct stat st;
+		if(fstat(fd,&st) || (size_t) st.st_size < sizeof(Header)) {
+			::close(fd);
+			return;
+		}
+
+		void *data = mmap(NULL,(size_t) st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		::close(fd);
+
+		if(data == MAP_FAILED) {
+			Logger::String{"Cant map ",filename.c_str(),": ",strerror(errno)}.warning("snapshot");
+			return;
+		}
+
+		const Header *header = (const Header *) data;
+		if(memcmp(header->magic,magic,sizeof(magic)) || header->version != version || header->size != sizeof(Record)
+			|| header->count > (((size_t) st.st_size - sizeof(Header)) / sizeof(Record))) {
+			Logger::String{"Ignoring invalid snapshot ",filename.c_str()}.warning("snapshot");
+			munmap(data,(size_t) st.st_size);
+			return;
+		}
+
+		file.data = data;
+		file.length = (size_t) st.st_size;
+		file.header = header;
+		file.records = (const Record *) (header+1);
+
+		entries.reserve(entries.size() + header->count);
+
+		Logger::String{"Snapshot with ",(unsigned long) header->count," agent(s), saved ",(unsigned long) (time(nullptr) - header->time),"s ago"}.write(Logger::Trace,"snapshot");
+
+	}
+
+	void IP::Snapshot::unload() noexcept {
+
+		if(file.data) {
+			munmap(file.data,file.length);
+		}
+
+		file.data = nullptr;
+		file.length = 0;
+		file.header = nullptr;
+		file.records = nullptr;
+
+	}
+
+	const IP::Snapshot::Record * IP::Snapshot::find(uint64_t key) const noexcept {
+
+		if(!file.records) {
+			return nullptr;
+		}
+
+		const Record *end = file.records + file.header->count;
+		const Record *record = std::lower_bound(file.records,end,key,[](const Record &r, uint64_t k) {
+			return r.key < k;
+		});
+
+		if(record != end && record->key == key) {
+			return record;
+		}
+
+		return nullptr;
+
+	}
+
+	uint64_t IP::Snapshot::key(const IP::Agent &agent) noexcept {
+
+		// Same name on another branch, another agent.
+		uint64_t value = hash("/",agent.snapshot.path ? agent.snapshot.path : hash(nullptr));
+		value = hash(agent.name(),value);
+
+		// Same name, other host; the state is not the same.
+		const DNS::Agent *dns = dynamic_cast<const DNS::Agent *>(&agent);
+		if(dns) {
+			value = hash(":",value);
+			value = hash(dns->hostname,value);
+		}
+
+		return value ? value : 1;
+
+	}
+
+	void IP::Snapshot::insert(IP::Agent &agent) {
+
+		if(filename.empty() || agent.snapshot.key) {
+			return;
+		}
+
+		Record record;
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			uint64_t k = key(agent);
+
+			auto it = entries.find(k);
+			if(it != entries.end()) {
+
+				if(it->second.agent) {
+					Logger::String{"Another agent has the same name, not keeping it on the snapshot"}.write(Logger::Trace,agent.name());
+					return;
+				}
+
+				// Reloaded, the state of the previous agent.
+				record = it->second.record;
+				it->second.agent = &agent;
+
+			} else {
+
+				load();
+
+				Entry &entry = entries[k];
+				entry.agent = &agent;
+				entry.record.key = k;
+
+				const Record *saved = find(k);
+				if(saved) {
+					entry.record = *saved;
+					record = *saved;
+				}
+
+			}
+
+			agent.snapshot.key = k;
+
+			if(!timer) {
+				timer.reset(new Timer{*this});
+			}
+
+		}
+
+		uint64_t now = (uint64_t) time(nullptr);
+		if(record.time && record.time <= now && (now - record.time) <= age) {
+			restore(agent,record);
+		}
+
+	}
+
+	void IP::Snapshot::remove(IP::Agent &agent) {
+
+		lock_guard<mutex> lock(guard);
+
+		auto it = entries.find(agent.snapshot.key);
+		if(it != entries.end() && it->second.agent == &agent) {
+			capture(it->second.record,agent);
+			it->second.agent = nullptr;
+		}
+
+		agent.snapshot.key = 0;
+
+	}
+
+	void IP::Snapshot::capture(Record &record, const IP::Agent &agent) noexcept {
+
+		// Set by the probes, from other threads.
+		ICMP::Response response[2];
+		{
+			lock_guard<mutex> lock(agent.guard);
+
+			if(agent.snapshot.time) {
+				// Not probed since the restore, keep the saved state and its time.
+				return;
+			}
+
+			response[0] = agent.icmp.family[0];
+			response[1] = agent.icmp.family[1];
+		}
+
+		record.time = (uint64_t) time(nullptr);
+
+		ICMP::Statistics::Summary summary = agent.getStatistics();
+		record.sent = summary.sent;
+		record.received = summary.received;
+		record.duplicates = summary.duplicates;
+		record.reordered = summary.reordered;
+		record.jitter = summary.jitter;
+		record.last = summary.last;
+		record.min = summary.min;
+		record.avg = summary.avg;
+		record.max = summary.max;
+		record.loss = summary.loss;
+
+		store(record.family[0],record.address[0],agent);
+		record.response[0] = response[0];
+
+		if(agent.secondary) {
+			store(record.family[1],record.address[1],*agent.secondary);
+			record.response[1] = response[1];
+		} else {
+			store(record.family[1],record.address[1],sockaddr_storage{});
+			record.response[1] = ICMP::invalid;
+		}
+
+		const DNS::Agent *dns = dynamic_cast<const DNS::Agent *>(&agent);
+		record.dns = dns ? dns->code : -1;
+
+	}
+
+	void IP::Snapshot::restore(IP::Agent &agent, const Record &record) {
+
+		if(agent.IP::Address::empty()) {
+
+			// Resolved by the DNS, it's refreshed on the first query.
+			if(record.family[0]) {
+				agent.IP::Address::set(address(record.family[0],record.address[0]));
+			}
+
+		} else {
+
+			uint8_t family;
+			uint8_t current[16];
+			store(family,current,agent);
+
+			if(family != record.family[0] || memcmp(current,record.address[0],sizeof(current))) {
+				// The address was changed, the saved state is from another host.
+				return;
+			}
+
+		}
+
+		if(agent.secondary && agent.secondary->IP::Address::empty() && record.family[1] == AF_INET6) {
+			agent.secondary->IP::Address::set(address(record.family[1],record.address[1]));
+		}
+
+		{
+			ICMP::Statistics::Summary summary;
+			summary.sent = record.sent;
+			summary.received = record.received;
+			summary.duplicates = record.duplicates;
+			summary.reordered = record.reordered;
+			summary.jitter = record.jitter;
+			summary.last = record.last;
+			summary.min = record.min;
+			summary.avg = record.avg;
+			summary.max = record.max;
+			summary.loss = record.loss;
+			agent.restore(summary);
+		}
+
+		DNS::Agent *dns = dynamic_cast<DNS::Agent *>(&agent);
+		if(dns && record.dns >= 0) {
+			dns->set((int) record.dns,dns->hostname);
+		}
+
+		{
+			lock_guard<mutex> lock(agent.guard);
+			agent.snapshot.time = record.time;
+			agent.icmp.family[0] = (ICMP::Response) record.response[0];
+			agent.icmp.family[1] = (ICMP::Response) record.response[1];
+		}
+		agent.update();
+
+	}
+
+	void IP::Snapshot::save() {
+		uint64_t number;
+		auto records = collect(number);
+		write(records,number);
+	}
+
+	vector<IP::Snapshot::Record> IP::Snapshot::collect(uint64_t &number) {
+
+		vector<Record> records;
+
+		if(filename.empty()) {
+			number = 0;
+			return records;
+		}
+
+		lock_guard<mutex> lock(guard);
+
+		// The file is replaced, keep the saved state of the agents not started yet.
+		load();
+		if(file.records) {
+			for(const Record *record = file.records; record < (file.records + file.header->count); record++) {
+				if(!entries.count(record->key)) {
+					entries[record->key].record = *record;
+				}
+			}
+			unload();
+		}
+
+		uint64_t now = (uint64_t) time(nullptr);
+
+		records.reserve(entries.size());
+		for(auto it = entries.begin(); it != entries.end();) {
+
+			Entry &entry = it->second;
+			if(entry.agent) {
+				capture(entry.record,*entry.agent);
+			} else if(!entry.record.time || entry.record.time > now || (now - entry.record.time) > age) {
+				// Gone and too old to be restored.
+				it = entries.erase(it);
+				continue;
+			}
+
+			if(entry.record.time) {
+				records.push_back(entry.record);
+			}
+
+			it++;
+
+		}
+
+		number = ++serial.collected;
+		return records;
+
+	}
+
+	void IP::Snapshot::write(vector<Record> &records, uint64_t number) {
+
+		if(filename.empty()) {
+			return;
+		}
+
+		lock_guard<mutex> serialize(writing);
+
+		if(number <= serial.written) {
+			// A later capture was written first.
+			return;
+		}
+
+		Header header;
+		memset(&header,0,sizeof(header));
+		memcpy(header.magic,magic,sizeof(magic));
+		header.version = version;
+		header.size = sizeof(Record);
+		header.time = (uint64_t) time(nullptr);
+
+		std::sort(records.begin(),records.end(),[](const Record &a, const Record &b) {
+			return a.key < b.key;
+		});
+
+		header.count = records.size();
+
+		// Write a new file and replace the old one, a crash never leaves a partial snapshot.
+		std::string tempname{filename + ".tmp"};
+
+		int fd = open(tempname.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0640);
+		if(fd < 0) {
+			Logger::String{"Cant create ",tempname.c_str(),": ",strerror(errno)}.error("snapshot");
+			return;
+		}
+
+		auto output = [fd](const void *data, size_t length) {
+			const uint8_t *ptr = (const uint8_t *) data;
+			while(length) {
+				ssize_t bytes = ::write(fd,ptr,length);
+				if(bytes < 0) {
+					if(errno == EINTR) {
+						continue;
+					}
+					return false;
+				}
+				ptr += bytes;
+				length -= (size_t) bytes;
+			}
+			return true;
+		};
+
+		if(!output(&header,sizeof(header)) || !output(records.data(),records.size() * sizeof(Record)) || fsync(fd)) {
+			Logger::String{"Cant write ",tempname.c_str(),": ",strerror(errno)}.error("snapshot");
+			::close(fd);
+			unlink(tempname.c_str());
+			return;
+		}
+
+		::close(fd);
+
+		if(rename(tempname.c_str(),filename.c_str())) {
+			Logger::String{"Cant replace ",filename.c_str(),": ",strerror(errno)}.error("snapshot");
+			unlink(tempname.c_str());
+			return;
+		}
+
+		serial.written = number;
+		Logger::String{"Snapshot of ",records.size()," agent(s) saved"}.write(Logger::Debug,"snapshot");
+
+	}
+
+ }
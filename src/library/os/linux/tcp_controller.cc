@@ -0,0 +1,441 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ #include <config.h>
+ #include <private/linux/tcp_controller.h>
+
+ #include <unistd.h>
+ #include <sys/types.h>
+ #include <sys/socket.h>
+ #include <sys/epoll.h>
+ #include <sys/resource.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <system_error>
+ #include <algorithm>
+ #include <cstring>
+
+ namespace Udjat {
+
+	static uint64_t nanoseconds() noexcept {
+		struct timespec tm;
+		clock_gettime(CLOCK_MONOTONIC, &tm);
+		return (((uint64_t) tm.tv_sec) * 1000000000ULL) + ((uint64_t) tm.tv_nsec);
+	}
+
+	static inline uint64_t milliseconds() noexcept {
+		return nanoseconds() / 1000000ULL;
+	}
+
+	TCP::Controller & TCP::Controller::getInstance() {
+		static Controller instance;
+		return instance;
+	}
+
+	TCP::Controller::Controller() : MainLoop::Handler(-1, MainLoop::Handler::oninput) {
+		tokens = (uint32_t) nanoseconds();
+	}
+
+	TCP::Controller::~Controller() {
+
+		lock_guard<mutex> lock(guard);
+
+		for(Probe &probe : probes) {
+			release(probe);
+		}
+
+		stop();
+
+	}
+
+	void TCP::Controller::start() {
+
+		if(Handler::values.fd >= 0) {
+			return;
+		}
+
+		Logger::String{"Starting connect probes"}.write(Logger::Trace,"TCP");
+
+		// One descriptor per connect in flight, use all the process is allowed to.
+		static bool limits = false;
+		if(!limits) {
+			limits = true;
+			struct rlimit rl;
+			if(!getrlimit(RLIMIT_NOFILE,&rl) && rl.rlim_cur < rl.rlim_max) {
+				rl.rlim_cur = rl.rlim_max;
+				if(setrlimit(RLIMIT_NOFILE,&rl)) {
+					Logger::String{"Cant raise the descriptor limit: ",strerror(errno)}.write(Logger::Trace,"TCP");
+				} else {
+					Logger::String{"Descriptor limit raised to ",(unsigned long) rl.rlim_cur}.write(Logger::Trace,"TCP");
+				}
+			}
+		}
+
+		// The epoll descriptor is readable when any connect finishes, the main loop watches only it.
+		Handler::values.fd = epoll_create1(EPOLL_CLOEXEC);
+		if(Handler::values.fd < 0) {
+			throw std::system_error(errno, std::system_category(), "Cant create epoll descriptor");
+		}
+
+		this->Handler::enable();
+
+	}
+
+	void TCP::Controller::stop() {
+
+		this->Handler::disable();
+		this->Timer::disable();
+		this->Handler::close();
+		wakeup = 0;
+
+		// Only called with an empty table, restart slots from zero.
+		probes.clear();
+		available.clear();
+		deadlines = decltype(deadlines)();
+
+		Logger::String{"Connect probes disabled"}.write(Logger::Debug,"TCP");
+
+	}
+
+	void TCP::Controller::insert(ICMP::Worker &worker) {
+
+		if(worker.busy.exchange(true)) {
+			throw std::system_error(EBUSY, std::system_category(), "TCP probe is already active");
+		}
+
+		worker.connector = this;
+
+		bool notify = false;
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			int sock = -1;
+
+			try {
+
+				start();
+
+				sock = socket(worker.ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+				if(sock < 0) {
+					throw std::system_error(errno, std::system_category(), "Cant create TCP socket");
+				}
+
+			} catch(...) {
+
+				worker.busy = false;
+				if(!active) {
+					stop();
+				}
+				throw;
+
+			}
+
+			// Reset on close, no FIN handshake and no TIME_WAIT for the probe.
+			struct linger lg = { 1, 0 };
+			setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+
+			uint32_t id;
+			if(!available.empty()) {
+				id = available.back();
+				available.pop_back();
+			} else {
+				id = (uint32_t) probes.size();
+				probes.emplace_back();
+			}
+
+			active++;
+
+			Probe &probe = probes[id];
+			probe.worker = &worker;
+			probe.sock = sock;
+			probe.token = ++tokens;
+			probe.seq = worker.statistics.sent();
+			probe.start = nanoseconds();
+			probe.timeout = (probe.start / 1000000ULL) + worker.timeout();
+
+			IP::Address addr{worker};
+			socklen_t length;
+			if(addr.ss_family == AF_INET6) {
+				((sockaddr_in6 *) &addr)->sin6_port = htons(worker.port);
+				length = sizeof(sockaddr_in6);
+			} else {
+				((sockaddr_in *) &addr)->sin_port = htons(worker.port);
+				length = sizeof(sockaddr_in);
+			}
+
+			if(!::connect(sock,(const sockaddr *) &addr,length)) {
+
+				// Loopback connects can finish right away.
+				finish(probe,0,nanoseconds());
+
+			} else if(errno != EINPROGRESS) {
+
+				finish(probe,errno,nanoseconds());
+
+			} else {
+
+				struct epoll_event event;
+				memset(&event,0,sizeof(event));
+				event.events = EPOLLOUT;
+				event.data.u64 = (((uint64_t) probe.token) << 32) | id;
+
+				if(epoll_ctl(Handler::values.fd,EPOLL_CTL_ADD,sock,&event)) {
+					finish(probe,errno,nanoseconds());
+				} else {
+					deadlines.push(Deadline{probe.timeout,id,probe.token});
+					if(!wakeup || probe.timeout < wakeup) {
+						arm(probe.start / 1000000ULL);
+					}
+				}
+
+			}
+
+			notify = delivery.pending();
+
+			if(!active) {
+				stop();
+			}
+
+		}
+
+		if(notify) {
+			// Don't notify the worker from its own start().
+			ThreadPool::getInstance().push([this]() {
+				deliver();
+			});
+		}
+
+	}
+
+	void TCP::Controller::remove(ICMP::Worker &worker) {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			for(Probe &probe : probes) {
+				if(probe.worker == &worker) {
+					release(probe);
+					break;
+				}
+			}
+
+			delivery.drop(worker);
+
+			worker.connector = nullptr;
+
+			if(!active && Handler::values.fd >= 0) {
+				stop();
+			}
+		}
+
+		delivery.wait(worker);
+
+	}
+
+	void TCP::Controller::finish(Probe &probe, int error, uint64_t time) {
+
+		ICMP::Response response;
+
+		switch(error) {
+		case 0:
+			{
+				// The kernel measured the handshake, it doesn't include the main loop latency.
+				uint64_t rtt = (time > probe.start ? time - probe.start : 0);
+
+				struct tcp_info info;
+				socklen_t length = sizeof(info);
+				if(!getsockopt(probe.sock,IPPROTO_TCP,TCP_INFO,&info,&length) && info.tcpi_rtt) {
+					rtt = ((uint64_t) info.tcpi_rtt) * 1000ULL;
+				}
+
+				probe.worker->statistics.received(probe.seq,rtt);
+				response = ICMP::echo_reply;
+			}
+			break;
+
+		case ECONNREFUSED:
+			// The host answered with a RST, it is up even with the port closed.
+			probe.worker->statistics.received(probe.seq,(time > probe.start ? time - probe.start : 0));
+			response = ICMP::echo_reply;
+			break;
+
+		case ETIMEDOUT:
+			response = ICMP::timeout;
+			break;
+
+		case ENETUNREACH:
+			response = ICMP::network_unreachable;
+			break;
+
+		default:
+			// EHOSTUNREACH, ...
+			response = ICMP::destination_unreachable;
+
+		}
+
+		if(Logger::enabled(Logger::Debug)) {
+			Logger::String{
+				std::to_string((const sockaddr_storage &) *probe.worker),":",probe.worker->port," ",
+				(error ? strerror(error) : "connected")
+			}.write(Logger::Debug,"TCP");
+		}
+
+		delivery.post(*probe.worker,response,*probe.worker);
+		release(probe);
+
+	}
+
+	void TCP::Controller::release(Probe &probe) noexcept {
+
+		if(!probe.active()) {
+			return;
+		}
+
+		// Closing the socket removes it from the epoll set.
+		::close(probe.sock);
+		probe.sock = -1;
+
+		probe.worker->busy = false;
+		probe.worker = nullptr;
+		available.push_back((uint32_t) (&probe - probes.data()));
+		active--;
+
+	}
+
+	void TCP::Controller::arm(uint64_t now) {
+
+		// Drop entries of finished connects.
+		while(!deadlines.empty()) {
+			const Deadline &deadline = deadlines.top();
+			const Probe &probe = probes[deadline.id];
+			if(probe.active() && probe.token == deadline.token) {
+				break;
+			}
+			deadlines.pop();
+		}
+
+		if(deadlines.empty()) {
+			wakeup = 0;
+			this->Timer::disable();
+			return;
+		}
+
+		wakeup = deadlines.top().time;
+		this->Timer::reset(wakeup > now ? (unsigned long) (wakeup - now) : 1UL);
+		if(!this->Timer::enabled()) {
+			this->Timer::enable();
+		}
+
+	}
+
+	void TCP::Controller::on_timer() {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			uint64_t now = milliseconds();
+
+			while(!deadlines.empty() && deadlines.top().time <= now) {
+
+				Deadline deadline = deadlines.top();
+				deadlines.pop();
+
+				Probe &probe = probes[deadline.id];
+				if(!probe.active() || probe.token != deadline.token) {
+					continue;	// Finished.
+				}
+
+				delivery.post(*probe.worker,ICMP::timeout,*probe.worker);
+				release(probe);
+
+			}
+
+			if(active) {
+				arm(now);
+			} else if(Handler::values.fd >= 0) {
+				stop();
+			}
+		}
+
+		deliver();
+
+	}
+
+	void TCP::Controller::handle_event(const Event) {
+
+		{
+			lock_guard<mutex> lock(guard);
+
+			static constexpr int length = 256;
+			struct epoll_event events[length];
+			int count;
+
+			do {
+
+				count = epoll_wait(Handler::values.fd,events,length,0);
+				if(count < 0) {
+					if(errno != EINTR) {
+						Logger::String{"Error waiting for connects: ",strerror(errno)}.error("TCP");
+					}
+					break;
+				}
+
+				uint64_t now = nanoseconds();
+
+				for(int ix = 0; ix < count; ix++) {
+
+					uint32_t id = (uint32_t) (events[ix].data.u64 & 0xFFFFFFFF);
+					uint32_t token = (uint32_t) (events[ix].data.u64 >> 32);
+
+					if(id >= probes.size()) {
+						continue;
+					}
+
+					Probe &probe = probes[id];
+					if(!probe.active() || probe.token != token) {
+						continue;
+					}
+
+					int error = 0;
+					socklen_t len = sizeof(error);
+					if(getsockopt(probe.sock,SOL_SOCKET,SO_ERROR,&error,&len)) {
+						error = errno;
+					}
+
+					finish(probe,error,now);
+
+				}
+
+			} while(count == length);
+
+			if(active) {
+				arm(milliseconds());
+			} else if(Handler::values.fd >= 0) {
+				stop();
+			}
+		}
+
+		deliver();
+
+	}
+
+ }
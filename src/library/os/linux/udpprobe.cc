@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Copyright (C) 2025 Perry Werneck <perry.werneck@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+ /*
+  * UDP probes share the host table, scheduler and send batches of the ICMP controller, only
+  * the socket is different. A closed port answers with ICMP port unreachable, queued by the
+  * kernel on the socket error queue with the probe payload; a down host doesn't answer.
+  */
+
+ #include <config.h>
+ #include <private/linux/icmp_controller.h>
+
+ #include <unistd.h>
+ #include <sys/types.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <linux/errqueue.h>
+ #include <udjat/tools/threadpool.h>
+ #include <udjat/tools/logger.h>
+ #include <system_error>
+ #include <cstring>
+
+ namespace Udjat {
+
+	void ICMP::Controller::UDP::start() {
+
+		if(values.fd >= 0) {
+			return;
+		}
+
+		values.fd = socket(AF_INET, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+		if(values.fd < 0) {
+			throw std::system_error(errno, std::system_category(), "Cant create UDP socket");
+		}
+
+		// Without it the ICMP errors of an unconnected socket are dropped.
+		int on = 1;
+		if(setsockopt(values.fd, SOL_IP, IP_RECVERR, &on, sizeof(on))) {
+			int err = errno;
+			::close(values.fd);
+			values.fd = -1;
+			throw std::system_error(err, std::system_category(), "Cant enable UDP error queue");
+		}
+
+		Logger::String{"UDP probes enabled on shard ",controller.index}.write(Logger::Trace,"ICMP");
+		enable();
+
+	}
+
+	void ICMP::Controller::UDP::stop() noexcept {
+
+		output.clear();
+
+		if(values.fd >= 0) {
+			disable();
+			close();
+		}
+
+	}
+
+	void ICMP::Controller::UDP::handle_event(const Event) {
+
+		if(controller.threaded) {
+
+			this->Handler::disable();
+
+			ThreadPool::getInstance().push([this]() {
+				{
+					lock_guard<mutex> lock(controller.guard);
+					controller.datagrams();
+					if(values.fd >= 0) {
+						this->Handler::enable();
+					}
+				}
+				controller.deliver();
+			});
+
+			return;
+		}
+
+		{
+			lock_guard<mutex> lock(controller.guard);
+			controller.datagrams();
+		}
+		controller.deliver();
+
+	}
+
+	void ICMP::Controller::send(const sockaddr_storage &addr, uint16_t port, const Payload &payload) {
+
+		if(udp.fd() < 0) {
+			throw runtime_error("UDP probes are not available");
+		}
+
+		if(addr.ss_family != AF_INET) {
+			throw std::system_error(ENOTSUP, std::system_category(), "Unable to send UDP probe");
+		}
+
+		udp.output.packets.emplace_back();
+		udp.output.packets.back().payload = payload;
+
+		udp.output.addr.push_back(addr);
+		udp.output.lengths.push_back(0);
+		((sockaddr_in *) &udp.output.addr.back())->sin_port = htons(port);
+
+	}
+
+	void ICMP::Controller::datagrams() {
+
+		auto dispatch = [this](Host &host, int code, const sockaddr_storage &from, const Payload &payload, uint64_t time) {
+			if(host.onDatagram(code,from,payload,time)) {
+				release(host);
+			} else if(host.scheduled != host.deadline()) {
+				// Adaptive host, the next probe was moved.
+				schedule(host);
+				if(!wakeup || host.scheduled < wakeup) {
+					arm(getMilliseconds());
+				}
+			}
+		};
+
+		// Errors first, they are the common answer.
+		for(int flags : { (int) MSG_ERRQUEUE, 0 }) {
+
+			while(udp.fd() >= 0) {
+
+				input.reset();
+
+				int rc = recvmmsg(udp.fd(),input.msgs,Input::length,MSG_DONTWAIT|flags,NULL);
+				if(rc < 0) {
+					if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+						Logger::String{"Error '",strerror(errno),"' receiving UDP answers"}.error("ICMP");
+					}
+					break;
+				}
+
+				uint64_t time = getCurrentTime();
+
+				for(int ix = 0; ix < rc; ix++) {
+
+					if(!flags) {
+
+						// Services don't echo the payload, the reply answers the current probe of
+						// every host at the address; a dispatch can release the next one.
+						match(input.addr[ix],matched);
+						for(const Payload &payload : matched) {
+							Host *host = find(payload);
+							if(host) {
+								dispatch(*host,0,input.addr[ix],payload,time);
+							}
+						}
+
+						continue;
+					}
+
+					// The data is the payload of the probe, the name its destination.
+					const struct msghdr &msg = input.msgs[ix].msg_hdr;
+					if(input.msgs[ix].msg_len < sizeof(Payload)) {
+						continue;
+					}
+
+					for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *) &msg,cmsg)) {
+
+						if(cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+							continue;
+						}
+
+						// Local errors were reported by sendmmsg.
+						const struct sock_extended_err *err = (const struct sock_extended_err *) CMSG_DATA(cmsg);
+						if(err->ee_origin != SO_EE_ORIGIN_ICMP) {
+							continue;
+						}
+
+						Payload payload;
+						memcpy(&payload,input.buffer[ix],sizeof(Payload));
+
+						sockaddr_storage from;
+						memset(&from,0,sizeof(from));
+						memcpy(&from,SO_EE_OFFENDER(err),sizeof(sockaddr_in));
+
+						Host *host = find(payload);
+						if(host) {
+							dispatch(*host,err->ee_errno,from,payload,time);
+						}
+
+					}
+
+				}
+
+				if(((size_t) rc) < Input::length) {
+					break;
+				}
+
+			}
+
+		}
+
+	}
+
+	void ICMP::Controller::match(const sockaddr_storage &from, vector<Payload> &probes) noexcept {
+
+		probes.clear();
+
+		if(from.ss_family != AF_INET) {
+			return;
+		}
+
+		const sockaddr_in *sin = (const sockaddr_in *) &from;
+
+		auto range = services.equal_range(service(*sin,ntohs(sin->sin_port)));
+		for(auto it = range.first; it != range.second;) {
+
+			Host *host = find(it->second);
+			if(!host || host->worker->method != Worker::udp_datagram || host->worker->ss_family != AF_INET) {
+				// Released, the slot was reused by another probe.
+				it = services.erase(it);
+				continue;
+			}
+
+			const sockaddr_in *addr = (const sockaddr_in *) (const sockaddr_storage *) host->worker;
+			if(addr->sin_addr.s_addr == sin->sin_addr.s_addr && host->worker->port == ntohs(sin->sin_port)) {
+				Payload payload;
+				memset(&payload,0,sizeof(payload));
+				payload.id = host->id;
+				payload.token = host->token;
+				payload.seq = host->packets;
+				payload.time = host->sent;
+				probes.push_back(payload);
+				it++;
+				continue;
+			}
+
+			// The address of the worker changed.
+			it = services.erase(it);
+
+		}
+
+	}
+
+ }